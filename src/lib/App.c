@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <ctype.h>
 #include <time.h>
 #include <alloca.h>
 #include <errno.h>
@@ -14,6 +15,7 @@
 #include <math.h>
 #include <sched.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/time.h>
 #include <sys/signal.h>
 #include <signal.h>
@@ -25,24 +27,68 @@
 #include <pthread.h>
 
 #include "App.h"
+#include "App_Log.h"
 #include "App_build_info.h"
 #include "str.h"
 
-static TApp AppInstance;                             ///< Static App instance
+static TApp AppInstance = {                          ///< Static App instance
+    .LogLevel = { [0 ... APP_LIBSMAX - 1] = APP_EXTRA }    // Let everything through until initialized
+};
 __thread TApp *App = &AppInstance;                   ///< Per thread App pointer
 __thread char App_Buf[32];                           ///< Per thread char buffer
 static __thread char APP_LASTERROR[APP_ERRORSIZE];   ///< Last error is accessible through this
 
-static pthread_mutex_t App_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t App_mutex = PTHREAD_MUTEX_INITIALIZER;    ///< Log and initialization lock (shared with the log writer)
+static __thread char  *App_LogBuf = NULL;            ///< Per thread log record buffer
+static __thread size_t App_LogBufSize = 0;           ///< Per thread log record buffer size
+static int App_LogFd = -1;                           ///< Log file descriptor records are written to directly (-1: through the stream)
+
+//! Log cost accounting (times in nanoseconds)
+typedef struct {
+   volatile uint64_t Nb;                        ///< Number of messages written
+   volatile uint64_t Bytes;                     ///< Number of bytes written
+   volatile uint64_t Format;                    ///< Time spent formatting the records
+   volatile uint64_t Write;                     ///< Time spent handing the records to the writer (lock wait included)
+   volatile uint64_t Lock;                      ///< Time spent waiting for the log lock
+} TApp_LogCost;
+
+//! Call site (rate limits, cost accounting and log filter)
+typedef struct {
+   volatile uint64_t Key;                       ///< Call site key (0: free slot)
+   volatile int      Ready;                     ///< Call site description is set
+   const char       *File;                      ///< Source file
+   int               Line;                      ///< Source line
+   const char       *Format;                    ///< Format string
+   TApp_Lib          Lib;                       ///< Library id
+   TApp_LogLevel     Level;                     ///< Message level
+   volatile uint64_t Count;                     ///< Number of occurrences
+   volatile uint64_t Suppressed;                ///< Number of suppressed occurrences
+   volatile int64_t  Next;                      ///< Time after which the next occurrence is logged (ms, APP_EVERY_SECONDS)
+   volatile int      Filter;                    ///< Cached log filter result, generation of the filter * 4 + 2 if cached + logged
+   TApp_LogCost      Cost;                      ///< Cost of the messages of the site
+} TApp_LogSite;
+
+static TApp_LogSite AppLogSites[APP_LOGSITE_MAX];    ///< Call sites table
+static TApp_LogCost AppLogCosts[APP_LIBSMAX];        ///< Cost of the messages of each library
 
 static char* AppMemUnits[]    = { "KB", "MB", "GB", "TB" };
-static char* AppLibNames[]    = { "main", "rmn", "fst", "brp", "wb", "gmm", "vgrid", "interpv", "georef", "rpnmpi", "iris", "io", "mdlutil", "dyn", "phy", "midas", "eer", "tdpack", "mach", "spsdyn", "meta" };
-static char* AppLibLog[]      = { "", "RMN|", "FST|", "BRP|", "WB|", "GMM|", "VGRID|", "INTERPV|", "GEOREF|", "RPNMPI|", "IRIS|", "IO|", "MDLUTIL|", "DYN|", "PHY|", "MIDAS|", "EER|", "TDPACK|", "MACH|", "SPSDYN|", "META|" };
-static char* AppLevelNames[]  = { "INFO", "FATAL", "SYSTEM", "ERROR", "WARNING", "INFO", "STAT", "TRIVIAL", "DEBUG", "EXTRA" };
+char* AppLibNames[APP_LIBSMAX] = { "main", "rmn", "fst", "brp", "wb", "gmm", "vgrid", "interpv", "georef", "rpnmpi", "iris", "io", "mdlutil", "dyn", "phy", "midas", "eer", "tdpack", "mach", "spsdyn", "meta",
+                                 [APP_LIBMETA + 1 ... APP_LIBSMAX - 1] = "" };
+char* AppLibLog[APP_LIBSMAX]   = { "", "RMN|", "FST|", "BRP|", "WB|", "GMM|", "VGRID|", "INTERPV|", "GEOREF|", "RPNMPI|", "IRIS|", "IO|", "MDLUTIL|", "DYN|", "PHY|", "MIDAS|", "EER|", "TDPACK|", "MACH|", "SPSDYN|", "META|",
+                                 [APP_LIBMETA + 1 ... APP_LIBSMAX - 1] = "" };
+static int AppLibNb = APP_LIBMETA + 1;                  ///< Number of known libraries (static and registered at run time)
+
+//! Level of a library not registered yet (APP_VERBOSE_[name]), applied by App_LibRegisterDynamic
+typedef struct {
+    char  Name[APP_LIBNAMEMAX + 1];             ///< Library name (lower case)
+    char *Level;                                ///< Level string
+} TApp_LibPending;
+
+static TApp_LibPending AppLibPending[APP_LIBSMAX];      ///< Levels of libraries not registered yet
+static int AppLibPendingNb = 0;                         ///< Number of pending levels
+char* AppLevelNames[]  = { "INFO", "FATAL", "SYSTEM", "ERROR", "WARNING", "INFO", "STAT", "TRIVIAL", "DEBUG", "EXTRA" };
 static char* AppLevelColors[] = { "", APP_COLOR_RED, APP_COLOR_RED, APP_COLOR_RED, APP_COLOR_YELLOW, "", APP_COLOR_BLUE, "", APP_COLOR_LIGHTCYAN, APP_COLOR_CYAN };
 
-unsigned int App_OnceTable[APP_MAXONCE];         ///< Log once table
-
 //! Return last error
 char* App_ErrorGet(void)     { return APP_LASTERROR; }
 
@@ -67,7 +113,7 @@ int   App_IsAloneNode(void)  { return App->NbNodeMPI == 1; }
 //! Check if current process (PE) is allowed to log
 int   App_IsLogging(void)    { 
 #ifdef HAVE_MPI
-    return (App->Tolerance && (App->LogRank==-1 || App->LogRank == App->RankMPI || App->LogRank == App->ComponentRank));
+    return (App->Tolerance && (App->LogRank==-1 || App->LogRankOn));
 #else
     return App->Tolerance; 
 #endif
@@ -93,6 +139,7 @@ void App_SetMPIComm(MPI_Comm Comm) {
         App->CountsMPI = (int*)realloc(App->CountsMPI, (App->NbMPI + 1) * sizeof(int));
         App->DisplsMPI = (int*)realloc(App->DisplsMPI, (App->NbMPI + 1) * sizeof(int));
     }
+    App_LogRankSelect();
 }
 
 void App_SetMPIComm_F(MPI_Fint Comm) {
@@ -113,6 +160,49 @@ void App_LibRegister(
 }
 
 
+//! Find a library by name, or add it to the known libraries
+static int App_LibFind(
+    //! [in] Library name (case insensitive)
+    const char * const Name,
+    //! [in] Name length
+    const int Len,
+    //! [in] Add the library if not known
+    const int Add
+) {
+    //! \return Library id, -1 if not found, the name is longer than APP_LIBNAMEMAX or the table is full
+    //! \note Not locked, callers hold App_mutex
+    if (Len <= 0 || Len > APP_LIBNAMEMAX) return -1;
+
+    for(int l = 0; l < AppLibNb; l++) {
+        if (strncasecmp(AppLibNames[l], Name, Len) == 0 && AppLibNames[l][Len] == '\0') return l;
+    }
+    if (!Add || AppLibNb >= APP_LIBSMAX) return -1;
+
+    char *name = (char*)malloc(Len + 1);
+    char *log = (char*)malloc(Len + 2);
+    if (!name || !log) {
+        free(name);
+        free(log);
+        return -1;
+    }
+    for(int c = 0; c < Len; c++) {
+        name[c] = tolower(Name[c]);
+        log[c] = toupper(Name[c]);
+    }
+    name[Len] = '\0';
+    log[Len] = '|';
+    log[Len + 1] = '\0';
+
+    // New libraries follow the main log level until set, the log calls read the tables without locking
+    App->LogLevel[AppLibNb] = App->LogLevel[APP_MAIN];
+    __atomic_store_n(&AppLibLog[AppLibNb], log, __ATOMIC_RELEASE);
+    __atomic_store_n(&AppLibNames[AppLibNb], name, __ATOMIC_RELEASE);
+    __atomic_store_n(&AppLibNb, AppLibNb + 1, __ATOMIC_RELEASE);
+
+    return AppLibNb - 1;
+}
+
+
 //! Initialiser l'environnement dans la structure App
 void App_InitEnv() {
     pthread_mutex_lock(&App_mutex);
@@ -122,6 +212,7 @@ void App_InitEnv() {
             gettimeofday(&App->Time, NULL);
 
             App->TimerLog = App_TimerCreate();
+            App->TimerClock = getenv("APP_TIMER_CLOCK");
             App->Tolerance = APP_QUIET;
             App->Language = APP_EN;
             App->LogWarning = 0;
@@ -131,7 +222,25 @@ void App_InitEnv() {
             App->LogTime = FALSE;
             App->LogSplit = FALSE;
             App->LogFlush = FALSE;
+            App->LogAsync = 0;
+            App->LogAsyncPolicy = APP_LOGASYNC_BLOCK;
+            App->LogFormat = APP_LOG_TEXT;
+            App->LogAggregate = 0;
+            App->LogShared = 0;
+            App->LogMPIIO = 0;
+            App->LogRotate = 0;
+            App->LogRotateNb = 0;
+            App->LogCompress = FALSE;
+            App->LogMmap = 0;
+            App->LogRecorder = 0;
+            App->LogRecorderSize = 0;
+            App->LogCost = 0;
+            App->LogCostAll = FALSE;
+            App->LogCollect = FALSE;
+            App->LogFilter = 0;
             App->LogRank = 0;
+            App->LogRanks = NULL;
+            App->LogRankOn = TRUE;
             App->LogThread = FALSE;
             App->UTC = FALSE;
 
@@ -158,8 +267,8 @@ void App_InitEnv() {
             if ((envVarVal = getenv("APP_VERBOSE_UTC"))) {
                 App->UTC = TRUE;
             }
-            if ((envVarVal = getenv("APP_VERBOSE_RANK"))) {
-                App->LogRank = atoi(envVarVal);
+            if ((envVarVal = getenv("APP_VERBOSE_RANK")) && App_LogRanks(envVarVal) != APP_OK) {
+                fprintf(stderr, "(WARNING) Invalid rank selection: %s\n", envVarVal);
             }
             if ((envVarVal = getenv("APP_VERBOSE_THREAD"))) {
                 App->LogThread = atoi(envVarVal);
@@ -173,73 +282,98 @@ void App_InitEnv() {
             if ((envVarVal = getenv("APP_LOG_FLUSH"))) {
                 App->LogFlush = TRUE;
             }
-            if ((envVarVal = getenv("APP_TOLERANCE"))) {
-                App_ToleranceLevel(envVarVal);
-            }
-            if ((envVarVal = getenv("APP_NOTRAP"))) {
-                App->Signal = -1;
-            }
-
-            // Check verbose level of libraries
-            if ((envVarVal = getenv("APP_VERBOSE_RMN"))) {
-                Lib_LogLevel(APP_LIBRMN, envVarVal);
-            }
-            if ((envVarVal = getenv("APP_VERBOSE_FST"))) {
-                Lib_LogLevel(APP_LIBFST, envVarVal);
+            if ((envVarVal = getenv("APP_LOG_FORMAT"))) {
+                App_LogFormat(envVarVal);
             }
-            if ((envVarVal = getenv("APP_VERBOSE_BRP"))) {
-                Lib_LogLevel(APP_LIBBRP, envVarVal);
+            if ((envVarVal = getenv("APP_LOG_ASYNC"))) {
+                // Ring size per thread in KB
+                App->LogAsync = atoi(envVarVal) > 0 ? atoi(envVarVal) * 1024 : 1024 * 1024;
             }
-            if ((envVarVal = getenv("APP_VERBOSE_WB"))) {
-                Lib_LogLevel(APP_LIBWB, envVarVal);
+            if ((envVarVal = getenv("APP_LOG_ASYNC_POLICY"))) {
+                App->LogAsyncPolicy = strncasecmp(envVarVal, "DROP", 4) == 0 ? APP_LOGASYNC_DROP : APP_LOGASYNC_BLOCK;
             }
-            if ((envVarVal = getenv("APP_VERBOSE_GMM"))) {
-                Lib_LogLevel(APP_LIBGMM, envVarVal);
+            if ((envVarVal = getenv("APP_LOG_SHM"))) {
+                // Node ring size in KB
+                App->LogShared = atoi(envVarVal) > 0 ? atoi(envVarVal) * 1024 : 16 * 1024 * 1024;
             }
-            if ((envVarVal = getenv("APP_VERBOSE_VGRID"))) {
-                Lib_LogLevel(APP_LIBVGRID, envVarVal);
+            if ((envVarVal = getenv("APP_LOG_MPIIO"))) {
+                // Buffer size in KB
+                App->LogMPIIO = atoi(envVarVal) > 0 ? atoi(envVarVal) * 1024 : 1024 * 1024;
             }
-            if ((envVarVal = getenv("APP_VERBOSE_INTERPV"))) {
-                Lib_LogLevel(APP_LIBINTERPV, envVarVal);
+            if ((envVarVal = getenv("APP_LOG_ROTATE"))) {
+                // Segment size in MB, optionally followed by the number of segments kept
+                char *count = strchr(envVarVal, ',');
+                App->LogRotate = (atoi(envVarVal) > 0 ? atoi(envVarVal) : 100) * (int64_t)1024 * 1024;
+                App->LogRotateNb = count && atoi(count + 1) > 0 ? MAX(atoi(count + 1), 2) : 0;
             }
-            if ((envVarVal = getenv("APP_VERBOSE_GEOREF"))) {
-                Lib_LogLevel(APP_LIBGEOREF, envVarVal);
+            if ((envVarVal = getenv("APP_LOG_MMAP"))) {
+                // File extension chunk size in MB
+                App_LogMmap((atoi(envVarVal) > 0 ? atoi(envVarVal) : 64) * (int64_t)1024 * 1024);
             }
-            if ((envVarVal = getenv("APP_VERBOSE_RPNMPI"))) {
-                Lib_LogLevel(APP_LIBRPNMPI, envVarVal);
-            }
-            if ((envVarVal = getenv("APP_VERBOSE_IRIS"))) {
-                Lib_LogLevel(APP_LIBIRIS, envVarVal);
+            if ((envVarVal = getenv("APP_LOG_COMPRESS"))) {
+#ifdef HAVE_ZLIB
+                App->LogCompress = TRUE;
+#else
+                fprintf(stderr, "(WARNING) Log compression not available (no zlib support)\n");
+#endif
             }
-            if ((envVarVal = getenv("APP_VERBOSE_IO"))) {
-                Lib_LogLevel(APP_LIBIO, envVarVal);
+            if ((envVarVal = getenv("APP_LOG_FILTER")) && App_LogFilter(envVarVal) != APP_OK) {
+                fprintf(stderr, "(WARNING) Invalid log filter: %s\n", envVarVal);
             }
-            if ((envVarVal = getenv("APP_VERBOSE_MDLUTIL"))) {
-                Lib_LogLevel(APP_LIBMDLUTIL, envVarVal);
+            if ((envVarVal = getenv("APP_TIMER_HISTO"))) {
+                App_TimerRegionHisto(atoi(envVarVal) || strcasecmp(envVarVal, "TRUE") == 0);
             }
-            if ((envVarVal = getenv("APP_VERBOSE_DYN"))) {
-                Lib_LogLevel(APP_LIBDYN, envVarVal);
+            if ((envVarVal = getenv("APP_TIMER_TRACE"))) {
+                char *events = getenv("APP_TIMER_TRACE_EVENTS"), *steps = getenv("APP_TIMER_TRACE_STEPS");
+                if (App_TimerTrace(envVarVal, events ? atoi(events) : 0, steps) != APP_OK) {
+                    fprintf(stderr, "(WARNING) Invalid timer trace steps: %s\n", steps);
+                }
             }
-            if ((envVarVal = getenv("APP_VERBOSE_PHY"))) {
-                Lib_LogLevel(APP_LIBPHY, envVarVal);
+            if ((envVarVal = getenv("APP_LOG_COLLECT"))) {
+                App->LogCollect = strncasecmp(envVarVal, "DEFER", 5) == 0;
             }
-            if ((envVarVal = getenv("APP_VERBOSE_MIDAS"))) {
-                Lib_LogLevel(APP_LIBMIDAS, envVarVal);
+            if ((envVarVal = getenv("APP_LOG_COST"))) {
+                // Number of call sites reported, optionally followed by ALL to sum the libraries over the ranks
+                char *all = strchr(envVarVal, ',');
+                App_LogCost(atoi(envVarVal) > 0 ? atoi(envVarVal) : 10, all && strncasecmp(all + 1, "ALL", 3) == 0);
             }
-            if ((envVarVal = getenv("APP_VERBOSE_EER"))) {
-                Lib_LogLevel(APP_LIBEER, envVarVal);
+            if ((envVarVal = getenv("APP_LOG_AGGREGATE"))) {
+                // Number of writer ranks
+                App->LogAggregate = atoi(envVarVal) > 0 ? atoi(envVarVal) : 1;
             }
-            if ((envVarVal = getenv("APP_VERBOSE_TDPACK"))) {
-                Lib_LogLevel(APP_LIBTDPACK, envVarVal);
+            if ((envVarVal = getenv("APP_TOLERANCE"))) {
+                App_ToleranceLevel(envVarVal);
             }
-            if ((envVarVal = getenv("APP_VERBOSE_MACH"))) {
-                Lib_LogLevel(APP_LIBMACH, envVarVal);
+            if ((envVarVal = getenv("APP_NOTRAP"))) {
+                App->Signal = -1;
             }
-            if ((envVarVal = getenv("APP_VERBOSE_SPSDYN"))) {
-                Lib_LogLevel(APP_LIBSPSDYN, envVarVal);
+            if ((envVarVal = getenv("APP_LOG_RECORDER"))) {
+                // Recorder level, optionally followed by the ring size per thread in KB
+                char *size = strchr(envVarVal, ',');
+                App_LogRecorder(envVarVal, size && atoi(size + 1) > 0 ? atoi(size + 1) * 1024 : 0);
             }
-            if ((envVarVal = getenv("APP_VERBOSE_META"))) {
-                Lib_LogLevel(APP_LIBMETA, envVarVal);
+
+            // Check verbose level of libraries in a single pass, levels of unknown libraries are kept for a later App_LibRegisterDynamic
+            for(char **env = environ; env && *env; env++) {
+                if (strncmp(*env, "APP_VERBOSE_", 12) == 0 && (envVarVal = strchr(*env, '='))) {
+                    const char * const name = *env + 12;
+                    const int          len = envVarVal - name;
+                    int                lib;
+
+                    if ((len == 5 && strncmp(name, "NOBOX", 5) == 0) || (len == 5 && strncmp(name, "COLOR", 5) == 0) ||
+                        (len == 4 && strncmp(name, "TIME", 4) == 0) || (len == 3 && strncmp(name, "UTC", 3) == 0) ||
+                        (len == 4 && strncmp(name, "RANK", 4) == 0) || (len == 6 && strncmp(name, "THREAD", 6) == 0)) {
+                        continue;
+                    }
+                    if ((lib = App_LibFind(name, len, FALSE)) > 0) {
+                        Lib_LogLevel(lib, envVarVal + 1);
+                    } else if (lib < 0 && len > 0 && len <= APP_LIBNAMEMAX && AppLibPendingNb < APP_LIBSMAX) {
+                        TApp_LibPending *pending = &AppLibPending[AppLibPendingNb++];
+                        for(int c = 0; c < len; c++) pending->Name[c] = tolower(name[c]);
+                        pending->Name[len] = '\0';
+                        pending->Level = strdup(envVarVal + 1);
+                    }
+                }
             }
 
             // Check the language in the environment
@@ -252,6 +386,48 @@ void App_InitEnv() {
 }
 
 
+//! Register a library not known by App (info pour header de log, per library log level)
+TApp_Lib App_LibRegisterDynamic(
+    //! [in] Library name, its log level is set by APP_VERBOSE_[name]
+    const char * const Name,
+    //! [in] Version
+    const char * const Version
+) {
+    //! \return Library id to log with (\ref Lib_Log), or -1 if the name is longer than APP_LIBNAMEMAX
+    //!         or the maximum number of libraries (APP_LIBSMAX) is reached
+    //! \note Registering a known library (ie: "rmn") returns its id, a NULL version keeps the registered one
+    char *level = NULL;
+    int   lib, len;
+
+    if (!Name) return -1;
+
+    // The environment is read first, it holds the level of the libraries registered here
+    if (!App->Tolerance) App_InitEnv();
+
+    len = strlen(Name);
+    pthread_mutex_lock(&App_mutex);
+    if ((lib = App_LibFind(Name, len, FALSE)) < 0 && (lib = App_LibFind(Name, len, TRUE)) >= 0) {
+        // New library, take its level from the environment
+        for(int p = 0; p < AppLibPendingNb; p++) {
+            if (strcasecmp(AppLibPending[p].Name, Name) == 0) {
+                level = AppLibPending[p].Level;
+                AppLibPending[p] = AppLibPending[--AppLibPendingNb];
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&App_mutex);
+
+    if (level) {
+        Lib_LogLevel(lib, level);
+        free(level);
+    }
+    if (lib >= 0 && Version) App_LibRegister(lib, Version);
+
+    return lib;
+}
+
+
 //! Initialize an application
 TApp * App_Init(
     //! [in] Application type (APP_MASTER = single independent process, APP_THREAD = threaded co-process)
@@ -312,6 +488,7 @@ TApp * App_Init(
 #endif
 
         App_InitEnv();
+        App_LogRankSelect();
         
         // Trap signals if enabled (preemption)
         if (App->Signal == 0) {
@@ -349,6 +526,7 @@ void App_Free(void) {
                 APP_FREE(App->LibsVersion[t]);
             }
 
+            APP_FREE(App->LogRanks);
             APP_FREE(App->CountsMPI);
             APP_FREE(App->DisplsMPI);
             APP_FREE(App->OMPSeed);
@@ -600,10 +778,26 @@ void App_Start(void) {
 
     gettimeofday(&App->Time, NULL);
 
+    // Calibrate the time stamp counter before the timers are used
+    if (App->TimerClock && App_TimerClock(App->TimerClock) != APP_OK) {
+        fprintf(stderr, "(WARNING) Timer clock %s not available, using clock_gettime\n", App->TimerClock);
+    }
+
 #ifdef HAVE_MPI
     //! \bug The \ref App_SetMPIComm function sets App->Comm with the communicator provided as argument, but we provide App->Comm here.
     //! The only place where App->Comm is set is in \ref App_Init with MPI_COMM_WORLD as value
     App_SetMPIComm(App->Comm);
+
+    // Selecting the node heads to log needs the node grouping
+    if (App->LogRank == APP_LOGRANK_SET && strcasestr(App->LogRanks, "NODE") && App->NodeComm == MPI_COMM_NULL) {
+        App_NodeGroup();
+        App_LogRankSelect();
+    }
+
+    // Set up the node log rings, or else the log aggregation tree or the MPI-IO log file, before anything gets logged
+    if ((!App->LogShared || App_LogSharedInit() != APP_OK) && (!App->LogAggregate || App_LogAggregateInit() != APP_OK) && App->LogMPIIO) {
+        App_LogMPIIOInit();
+    }
 #endif
 
 #ifdef HAVE_OPENMP
@@ -907,6 +1101,10 @@ int App_End(
     unsigned long * const memt = &mem[App->NbMPI];
     double sum = mem[App->RankMPI] = usg.ru_maxrss;
 
+    // Report rate limited messages, records from other threads have to be out before the footer
+    App_LogSiteSummary();
+    App_LogAsyncFlush();
+
     App_LogStats("");
 
     // Get a readable size and units
@@ -915,13 +1113,19 @@ int App_End(
 
     double avg = 0.0, var = 0.0, maxd = 0.0, mind = 0.0, fijk = 0.0;
     unsigned int imin = 0, imax = 0;
+    int collective = FALSE;
 #ifdef HAVE_MPI
     // The Status = INT_MIN means something went wrong and we want to crash gracefully and NOT get stuck
     // on a MPI deadlock where we wait for a reduce and the other nodes are stuck on a BCast, for example
     if (App->NbMPI > 1 && Status != INT_MIN) {
+        collective = TRUE;
+
         // Get largest error code
         //MPI_Reduce(MPI_IN_PLACE, &Status, 1, MPI_INT, MPI_MIN, 0, App->Comm);
 
+        // Agree on the last deferred collective messages
+        App_LogCollectEnd(TRUE);
+
         if (!App->RankMPI) {
             MPI_Reduce(MPI_IN_PLACE, &App->LogWarning, 1, MPI_INT, MPI_SUM, 0, App->Comm);
             MPI_Reduce(MPI_IN_PLACE, &App->LogError, 1, MPI_INT, MPI_SUM, 0, App->Comm);
@@ -930,6 +1134,20 @@ int App_End(
             MPI_Reduce(&App->LogError, NULL, 1, MPI_INT, MPI_SUM, 0, App->Comm);
         }
 
+        // Collect the node rings, aggregated and MPI-IO records before the footer
+        App_LogSharedEnd(TRUE);
+        App_LogAggregateEnd(TRUE);
+        App_LogMPIIOSync();
+
+        // Sum the log cost of the libraries
+        if (App->LogCost && App->LogCostAll) {
+            App_LogCostReduce();
+        }
+
+        // Cross-rank statistics of the timer regions and timer events
+        App_TimerRegionReduce();
+        App_TimerTraceWrite(TRUE);
+
         // Calculate resident memory statistics
         MPI_Reduce(mem, memt, App->NbMPI, MPI_UNSIGNED_LONG, MPI_SUM, 0, App->Comm);
 
@@ -965,6 +1183,11 @@ int App_End(
         }
     }
 #endif
+    if (!collective) {
+        App_LogCollectEnd(FALSE);
+        App_TimerTraceWrite(FALSE);
+    }
+
     // Select status code based on error number
     if (Status < 0) {
         Status = App->LogError ? EXIT_FAILURE : EXIT_SUCCESS;
@@ -979,6 +1202,9 @@ int App_End(
         if (!App->LogNoBox) {
             struct timeval end;
             gettimeofday(&end, NULL);
+
+            // Keep the footer box in one segment of a rotating log file
+            App_LogRotateHold(TRUE);
             struct timeval dif;
             timersub(&end, &App->Time, &dif);
 
@@ -993,6 +1219,11 @@ int App_End(
                 App_Log(APP_VERBATIM, "Finish time    : %s", ctime(&end.tv_sec));
             }
             App_Log(APP_VERBATIM, "Execution time : %.4f seconds (%.2f ms logging)\n", (float)dif.tv_sec+dif.tv_usec/1000000.0, App_TimerTotalTime_ms(App->TimerLog));
+            if (App->LogCost) {
+                App_LogCostSummary();
+            }
+            App_TimerRegionReport();
+            App_TimerRegionStatReport();
             App_Log(APP_VERBATIM, "Resident mem   : %.1f %s\n", sum*factor, unit);
 
             if (App->NbMPI>1) {
@@ -1023,11 +1254,18 @@ int App_End(
             App_Log(APP_VERBATIM, "-------------------------------------------------------------------------------------\n");
         }
         App_LogClose();
+        App_LogRotateHold(FALSE);
 
         App->State = APP_DONE;
 #ifdef HAVE_MPI
     }
 #endif
+    // Other ranks do not close their stream but must drain their asynchronous records
+    App_LogAsyncStop();
+    App_LogSharedEnd(FALSE);
+    App_LogAggregateEnd(FALSE);
+    App_LogMPIIOEnd(collective);
+
     if (Status >= APP_EXIT) {
        exit((App->Signal > 0) ? 128 + App->Signal : Status);
     } else {
@@ -1072,8 +1310,28 @@ void App_LogStream(const char * const Stream) {
 }
 
 
+//! Open a log file written by this process only, with the memory mapped writer or in segments if configured
+FILE* App_LogFileOpen(
+    //! [in] Log file name
+    const char * const File,
+    //! [in] Open mode ("w" or "a")
+    const char * const Mode
+) {
+    //! \return Log stream, NULL on error
+    FILE *stream = NULL;
+
+    if (App->LogMmap && !(stream = App_LogMmapOpen(File, Mode))) {
+        fprintf(stderr, "(WARNING) Unable to map log file (%s), will use stdio instead\n", File);
+        App->LogMmap = 0;
+    }
+    return stream ? stream : App_LogRotateOpen(File, Mode);
+}
+
+
 //! Open log file
 void App_LogOpen(void) {
+    int owner = FALSE;
+
     pthread_mutex_lock(&App_mutex);
     {
         if (!App->LogStream) {
@@ -1081,6 +1339,20 @@ void App_LogOpen(void) {
                 App->LogStream = stdout;
             } else if (strcmp(App->LogFile, "stderr") == 0) {
                 App->LogStream = stderr;
+            } else if ((App->LogStream = App_LogSharedOpen())) {
+                // Records go to the node ring, written by the node head
+            } else if ((App->LogStream = App_LogAggregateOpen(&owner))) {
+                // Records go to (or through) the aggregating writer rank
+            } else if ((App->LogStream = App_LogMPIIOOpen())) {
+                // Records are written to the shared file at step boundaries
+            } else if (App->LogSplit && App_IsMPI()) {
+                // Split log file per MPI rank
+                const int maxFilePathLen = 4096;
+                char file[maxFilePathLen];
+                snprintf(file, maxFilePathLen, "%s.%06d", App->LogFile, App->RankMPI);
+                App->LogStream = App_LogFileOpen(file, "a");
+            } else if (!App_IsMPI()) {
+                App->LogStream = App_LogFileOpen(App->LogFile, "w");
             } else {
                 if (!App->RankMPI) {
                     App->LogStream = fopen(App->LogFile, "w");
@@ -1093,12 +1365,36 @@ void App_LogOpen(void) {
                 fprintf(stderr, "(WARNING) Unable to open log stream (%s), will use stdout instead\n", App->LogFile);
             }
 
-            // Split log file per MPI rank
-            const int maxFilePathLen = 4096;
-            char file[maxFilePathLen];
-            if (App->LogSplit && App_IsMPI()) {
-                snprintf(file, maxFilePathLen, "%s.%06d", App->LogFile, App->RankMPI);
-                App->LogStream = freopen(file, "a", App->LogStream);
+            // Binary logs need a file, and a header when the file is created
+            if (App->LogFormat == APP_LOG_BINARY) {
+                if (App->LogStream == stdout || App->LogStream == stderr) {
+                    fprintf(stderr, "(WARNING) Binary log format needs a log file, will use text format instead\n");
+                    App->LogFormat = APP_LOG_TEXT;
+                } else if ((!App->RankMPI || App->LogSplit || owner) && fseek(App->LogStream, 0, SEEK_END) == 0 && ftell(App->LogStream) == 0) {
+                    App_LogBinaryHeader(App->LogStream);
+
+                    // Other ranks append to the same file, do not overwrite their records
+                    if (App_IsMPI() && !App->LogSplit && !owner) {
+                        App->LogStream = freopen(App->LogFile, "a", App->LogStream);
+                    }
+                }
+            }
+
+            // Records of ranks sharing the file (or flushed one by one) are written with a single write on an O_APPEND descriptor
+            if (App->LogStream != stdout && App->LogStream != stderr && ((App_IsMPI() && !App->LogSplit && !owner) || App->LogFlush)) {
+                int fd = fileno(App->LogStream);
+                if (fd >= 0 && fflush(App->LogStream) == 0 && fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_APPEND) == 0) {
+                    App_LogFd = fd;
+                }
+            }
+
+            // The crash handler of the flight recorder can not ask the stream for its descriptor
+            App_LogRecorderStream(App->LogStream);
+
+            // Start the asynchronous writer
+            if (App->LogAsync && App_LogAsyncStart(App->LogStream) != APP_OK) {
+                fprintf(stderr, "(WARNING) Unable to start asynchronous log writer, will log synchronously\n");
+                App->LogAsync = 0;
             }
         }
     } // end OMP critical
@@ -1108,17 +1404,24 @@ void App_LogOpen(void) {
 
 //! Close logfile
 void App_LogClose(void) {
+    // Drain the asynchronous writer before closing its stream
+    App_LogAsyncStop();
+
     pthread_mutex_lock(&App_mutex);
     {
         fflush(App->LogStream);
 
         if (App->LogStream && App->LogStream != stdout && App->LogStream != stderr) {
+            App_LogFd = -1;
+            App_LogRecorderStream(NULL);
             fclose(App->LogStream);
         }
     } // end OMP critical
     pthread_mutex_unlock(&App_mutex);
 }
 
+static void Lib_LogAllRanks(const TApp_Lib Lib, const TApp_LogLevel Level, const char * const Format, ...);
+
 //! Add log entry
 void App_Log4Fortran(
     //! [in] Niveau d'importance du message (MUST, ALWAYS, FATAL, SYSTEM, ERROR, WARNING, INFO, DEBUG, EXTRA)
@@ -1136,10 +1439,7 @@ void App_LogAllRanks4Fortran(
     //! [in] Message à jouter au journal
     const char *Message
 ) {
-   int32_t ___app_rank=App->LogRank;
-   App->LogRank=-1;
-   Lib_Log(APP_MAIN, Level, "%s\n", Message);
-   App->LogRank=___app_rank;
+   Lib_LogAllRanks(APP_MAIN, Level, "%s\n", Message);
 }
 
 void Lib_Log4Fortran(
@@ -1156,39 +1456,637 @@ void Lib_Log4Fortran(
     Lib_Log(Lib, Level, "%s\n", Message);
 }
 
-//! Add log entry
-void Lib_Log(
+//! Check from Fortran if a message of a given level would be processed (see \ref Lib_LogEnabled)
+int Lib_LogEnabled4Fortran(
     //! [in] Library id
     const TApp_Lib Lib,
-    //! [in] Message level. See \ref TApp_LogLevel
+    //! [in] Message level
+    const int Level
+) {
+    //! \return FALSE only if the message would be discarded without any side effect, so it does not need to be formatted
+    const int level = Level < 0 ? Level : Level & ~APP_LOGRATE_MASK;
+    return level <= APP_WARNING || level > APP_EXTRA || level <= App->LogLevel[Lib] || level <= App->LogRecorder;
+}
+
+//! Add log entry from a Fortran buffer, without copying it
+void Lib_LogN4Fortran(
+    //! [in] Library id
+    const TApp_Lib Lib,
+    //! [in] Message level
     const TApp_LogLevel Level,
+    //! [in] Fortran character buffer (not terminated)
+    const char * const Message,
+    //! [in] Buffer length, trailing blanks are not written
+    const int Len,
+    //! [in] Log from all ranks
+    const int AllRanks
+) {
+    int len = Len;
+
+    while (len > 0 && Message[len - 1] == ' ') len--;
+
+    if (AllRanks) {
+        Lib_LogAllRanks(Lib, Level, "%.*s\n", len, Message);
+    } else {
+        Lib_Log(Lib, Level, "%.*s\n", len, Message);
+    }
+}
+
+//! Per thread cache of the log message prefix parts
+typedef struct {
+    int    Init;                             ///< Static parts are valid
+    int    Step;                             ///< Step the level parts were built for
+    int    Rank;                             ///< Rank the head part was built for (-1: no rank)
+    pid_t  Tid;                              ///< Thread id the head part was built for (-1: no thread)
+    char   Head[32];                         ///< Rank and thread part ("P000T001 ")
+    int    HeadLen;
+    char   Level[APP_EXTRA + 1][32];         ///< Level and step part per level ("(INFO) #12 ")
+    int    LevelLen[APP_EXTRA + 1];
+    TApp_LogTime TimeMode;                   ///< Time format the time part was built for
+    int    TimeUTC;                          ///< UTC flag the time part was built for
+    time_t TimeSec;                          ///< Second the time part was built for
+    char   Time[32];                         ///< Time part
+    int    TimeLen;
+} TApp_LogPrefixCache;
+
+static __thread TApp_LogPrefixCache App_LogPrefixes;     ///< Per thread prefix cache
+static __thread pid_t App_LogTidCache = -1;              ///< Per thread id, relative to the process id (-1: not known yet)
+static pthread_once_t App_LogTidOnce = PTHREAD_ONCE_INIT;
+
+//! Forget the cached thread id in a forked child (called in the forking thread)
+static void App_LogTidReset(void) {
+    App_LogTidCache = -1;
+    App_LogPrefixes.Init = FALSE;
+}
+
+//! Register the fork handler for the thread id cache
+static void App_LogTidAtFork(void) {
+    pthread_atfork(NULL, NULL, App_LogTidReset);
+}
+
+//! Get the thread id of the calling thread, relative to the process id
+static inline pid_t App_LogTid(void) {
+    //! \return Thread id, 0 for the main thread
+    if (App_LogTidCache < 0) {
+        pthread_once(&App_LogTidOnce, App_LogTidAtFork);
+#ifndef _AIX
+        App_LogTidCache = (pid_t)syscall(SYS_gettid) - (pid_t)syscall(SYS_getpid);
+#else
+        App_LogTidCache = 0;
+#endif
+    }
+    return App_LogTidCache;
+}
+
+//! Get the current time for the log prefix
+static inline void App_LogNow(
+    //! [out] Current time
+    struct timeval *Now,
+    //! [in] Use a coarse clock (millisecond resolution or less is needed)
+    const int Coarse
+) {
+#ifdef CLOCK_REALTIME_COARSE
+    if (Coarse) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+        Now->tv_sec = ts.tv_sec;
+        Now->tv_usec = ts.tv_nsec / 1000;
+        return;
+    }
+#endif
+    gettimeofday(Now, NULL);
+}
+
+//! Build the time part of the log prefix, calendar strings are only formatted when the second changes
+static int App_LogPrefixTime(
+    //! [in] Prefix cache of the calling thread
+    TApp_LogPrefixCache * const Cache
+) {
+    //! \return Length of the time part in Cache->Time
+    struct timeval now, diff;
+    struct tm      tm;
+
+    if (Cache->TimeMode != App->LogTime || Cache->TimeUTC != App->UTC) {
+        Cache->TimeMode = App->LogTime;
+        Cache->TimeUTC = App->UTC;
+        Cache->TimeSec = -1;
+    }
+
+    switch(App->LogTime) {
+    case APP_DATETIME:
+        App_LogNow(&now, TRUE);
+        if (now.tv_sec != Cache->TimeSec) {
+            Cache->TimeSec = now.tv_sec;
+            App->UTC ? gmtime_r(&now.tv_sec, &tm) : localtime_r(&now.tv_sec, &tm);
+            Cache->TimeLen = strftime(Cache->Time, 32, "%c ", &tm);
+        }
+        break;
+    case APP_TIME:
+        App_LogNow(&now, TRUE);
+        timersub(&now, &App->Time, &diff);
+        // The coarse clock can lag behind the start time by a tick
+        if (diff.tv_sec < 0) timerclear(&diff);
+        if (diff.tv_sec != Cache->TimeSec) {
+            Cache->TimeSec = diff.tv_sec;
+            App->UTC ? gmtime_r(&diff.tv_sec, &tm) : localtime_r(&diff.tv_sec, &tm);
+            Cache->TimeLen = strftime(Cache->Time, 32, "%T ", &tm);
+        }
+        break;
+    case APP_SECOND:
+        App_LogNow(&now, FALSE);
+        timersub(&now, &App->Time, &diff);
+        Cache->TimeLen = snprintf(Cache->Time, 32, "%-8.3f ", diff.tv_sec + diff.tv_usec / 1000000.0);
+        break;
+    case APP_MSECOND:
+        App_LogNow(&now, TRUE);
+        timersub(&now, &App->Time, &diff);
+        // The coarse clock can lag behind the start time by a tick
+        if (diff.tv_sec < 0) timerclear(&diff);
+        Cache->TimeLen = snprintf(Cache->Time, 32, "%-8li ", diff.tv_sec * 1000 + diff.tv_usec / 1000);
+        break;
+    default:
+        Cache->TimeLen = 0;
+    }
+    return Cache->TimeLen;
+}
+
+//! Build the log message prefix (color, time, rank, thread, level, step and library)
+static void App_LogPrefix(
+    //! [out] Prefix (at least 256 characters)
+    char * const Prefix,
+    //! [in] Library id
+    const TApp_Lib Lib,
+    //! [in] Message level (APP_ALWAYS to APP_EXTRA)
+    const TApp_LogLevel Level,
+    //! [in] Thread id
+    const pid_t Tid,
+    //! [in] Message logged from all ranks
+    const int AllRanks
+) {
+    //! \note The static parts are cached per thread and only rebuilt when the step, rank or thread changes
+    TApp_LogPrefixCache *cache = &App_LogPrefixes;
+    char *color = App->LogColor ? AppLevelColors[Level] : AppLevelColors[APP_INFO];
+    int   rank = -1, len, n;
+
+#ifdef HAVE_MPI
+    if (App_IsMPI() && (AllRanks || App->LogRank == -1 || App->LogRank == APP_LOGRANK_SET) && !App->LogSplit) {
+        rank = App->RankMPI;
+    }
+#endif
+
+    if (!cache->Init || cache->Step != App->Step) {
+        for(int l = 0; l <= APP_EXTRA; l++) {
+            if (App->Step) {
+                cache->LevelLen[l] = snprintf(cache->Level[l], 32, "(%s) #%d ", AppLevelNames[l], App->Step);
+            } else {
+                cache->LevelLen[l] = snprintf(cache->Level[l], 32, "(%s) ", AppLevelNames[l]);
+            }
+            cache->LevelLen[l] = MIN(cache->LevelLen[l], 31);
+        }
+        cache->Step = App->Step;
+    }
+
+    if (!cache->Init || cache->Rank != rank || cache->Tid != (App->LogThread ? Tid : -1)) {
+        cache->Rank = rank;
+        cache->Tid = App->LogThread ? Tid : -1;
+        if (rank >= 0) {
+            cache->HeadLen = cache->Tid >= 0 ? snprintf(cache->Head, 32, "P%03dT%03d ", rank, Tid) : snprintf(cache->Head, 32, "P%03d ", rank);
+        } else {
+            cache->HeadLen = cache->Tid >= 0 ? snprintf(cache->Head, 32, "T%03d ", Tid) : 0;
+        }
+        cache->Head[cache->HeadLen] = '\0';
+        cache->Init = TRUE;
+    }
+
+    len = strlen(color);
+    memcpy(Prefix, color, len);
+    if (App->LogTime) {
+        n = App_LogPrefixTime(cache);
+        memcpy(Prefix + len, cache->Time, n);
+        len += n;
+    }
+    memcpy(Prefix + len, cache->Head, cache->HeadLen);
+    len += cache->HeadLen;
+    memcpy(Prefix + len, cache->Level[Level], cache->LevelLen[Level]);
+    len += cache->LevelLen[Level];
+    strcpy(Prefix + len, AppLibLog[Lib]);
+}
+
+//! Get a monotonic time in nanoseconds for the log cost accounting
+static inline uint64_t App_LogCostNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+//! Format a complete log record (prefix, message and color reset) into the per thread buffer
+static int App_LogRecord(
+    //! [in] Message prefix
+    const char * const Prefix,
     //! [in] printf style format string
     const char * const Format,
     //! [in] Variables referrenced in the format string
-    ...
+    va_list Args
 ) {
-    //! \note If level is ERROR, the message will be written on stderr, for all other levels the message will be written to stdout or the log file
-    //! \note If level is APP_FATAL or APP_SYSTEM, and APP_TOLERANCE is set to either of those, the application will exit, optionnally calling the finalize callback if define
-    //! \note If adding APP_COLLECT (ie: APP_FATAL+APP_COLLECT) to the message level, an MPI collective call will be made to get the lowest error level through all PEs (and potentially exit depending on previous point)
+    //! \return Length of the record in App_LogBuf, -1 on error
+    va_list args;
+    size_t  plen = strlen(Prefix);
+    size_t  rlen = App->LogColor ? strlen(APP_COLOR_RESET) : 0;
 
-    pid_t tid=0, pid=0;
-    TApp_LogLevel level=Level;
+    for(int pass = 0; pass < 2; pass++) {
+        if (App_LogBufSize > plen) {
+            memcpy(App_LogBuf, Prefix, plen);
+        }
+        va_copy(args, Args);
+        int n = vsnprintf(App_LogBufSize > plen ? App_LogBuf + plen : NULL, App_LogBufSize > plen ? App_LogBufSize - plen : 0, Format, args);
+        va_end(args);
+        if (n < 0) return -1;
+
+        size_t len = plen + n + rlen;
+        if (len < App_LogBufSize) {
+            if (rlen) memcpy(App_LogBuf + plen + n, APP_COLOR_RESET, rlen + 1);
+            return len;
+        }
+
+        // Grow the buffer and format again
+        char *buf = (char*)realloc(App_LogBuf, len + 1024);
+        if (!buf) return -1;
+        App_LogBuf = buf;
+        App_LogBufSize = len + 1024;
+    }
+    return -1;
+}
+
+//! Write a complete record to the log stream, through the node ring, the mapped file or the asynchronous writer if enabled
+static void App_LogEmit(
+    //! [in] Record
+    const char * const Rec,
+    //! [in] Record length
+    const int Len,
+    //! [in] Message level
+    const TApp_LogLevel Level,
+    //! [out] Time spent waiting for the log lock in nanoseconds (NULL if not needed)
+    uint64_t * const Lock
+) {
+    int urgent = Level == APP_ERROR || Level == APP_FATAL || Level == APP_SYSTEM;
+
+    if (App->LogShared && App_LogSharedPush(Rec, Len, urgent) == APP_OK) {
+        // The node head writes it out
+    } else if (App->LogMmap && App_LogMmapPush(Rec, Len) == APP_OK) {
+        // Copied into the mapped file
+    } else if (App->LogAsync && App_LogAsyncPush(Rec, Len) == APP_OK) {
+        // Errors must reach the stream before we go on (or exit)
+        if (urgent) App_LogAsyncFlush();
+    } else if (App_LogFd >= 0) {
+        // A single write on the O_APPEND descriptor, records of other ranks can not tear it
+        const char *rec = Rec;
+        ssize_t     n, len = Len;
+
+        while (len > 0 && ((n = write(App_LogFd, rec, len)) > 0 || errno == EINTR)) {
+            if (n > 0) {
+                rec += n;
+                len -= n;
+            }
+        }
+    } else {
+        if (Lock && pthread_mutex_trylock(&App_mutex)) {
+            uint64_t t = App_LogCostNow();
+            pthread_mutex_lock(&App_mutex);
+            *Lock = App_LogCostNow() - t;
+        } else if (!Lock) {
+            pthread_mutex_lock(&App_mutex);
+        }
+        fwrite(Rec, 1, Len, App->LogStream);
 
-    if (App->LogThread) {
-       tid = (pid_t) syscall(SYS_gettid);
-       pid = (pid_t) syscall(SYS_getpid);
-       tid -= pid;
+        // Binary records from different ranks sharing a file must not be split
+        if (App->LogFlush || App->LogColor || urgent || (App->LogFormat == APP_LOG_BINARY && App_IsMPI() && !App->LogSplit)) {
+            fflush(App->LogStream);
+        }
+        pthread_mutex_unlock(&App_mutex);
     }
+}
 
+//! Format a message into the flight recorder of the current thread instead of the log
+static void App_LogRecorderKeep(
+    //! [in] Library id
+    const TApp_Lib Lib,
+    //! [in] Message level, without the rate limiting bits
+    const TApp_LogLevel Level,
+    //! [in] printf style format string
+    const char * const Format,
+    //! [in] Variables referrenced in the format string
+    va_list Args
+) {
+    pid_t   tid = 0;
+    char   *rec, prefix[256];
+    int     len;
+    va_list args;
+
+    if (App->LogThread || App->LogFormat == APP_LOG_JSON) {
+       tid = App_LogTid();
+    }
+
+    va_copy(args, Args);
+    if (App->LogFormat == APP_LOG_JSON) {
+        len = App_LogJSONRecord(&rec, Lib, Level, tid, Format, args);
+    } else {
+        // Binary logs get text records too, they are dumped to stderr
+        App_LogPrefix(prefix, Lib, Level, tid, FALSE);
+        len = App_LogRecord(prefix, Format, args);
+        rec = App_LogBuf;
+    }
+    va_end(args);
+
+    if (len > 0) App_LogRecorderPush(rec, len);
+}
+
+//! Find the entry of a call site, claiming a free one for a new site
+static TApp_LogSite* App_LogSiteGet(
+    //! [in] Source file of the call site (NULL if unknown)
+    const char * const File,
+    //! [in] Source line of the call site
+    const int Line,
+    //! [in] Library id
+    const TApp_Lib Lib,
+    //! [in] Message level, without the rate limiting bits
+    const TApp_LogLevel Level,
+    //! [in] printf style format string
+    const char * const Format
+) {
+    //! \return Call site entry, NULL if the table is full
+    //! \note The table is lock free, a site is claimed by a compare and swap on its key
+    TApp_LogSite *site = NULL;
+    uint64_t      key, k;
+
+    // Mix the call site pointers, line and library, 0 marks a free slot
+    key = (uint64_t)(uintptr_t)File ^ ((uint64_t)(uintptr_t)Format << 1) ^ ((uint64_t)Line << 40) ^ ((uint64_t)Lib << 58);
+    key ^= key >> 33; key *= 0xFF51AFD7ED558CCDULL;
+    key ^= key >> 33; key *= 0xC4CEB9FE1A85EC53ULL;
+    key ^= key >> 33;
+    if (!key) key = 1;
+
+    for(int n = 0; n < APP_LOGSITE_MAX; n++) {
+        site = &AppLogSites[(key + n) & (APP_LOGSITE_MAX - 1)];
+        k = __atomic_load_n(&site->Key, __ATOMIC_ACQUIRE);
+        if (!k) {
+            if (__sync_bool_compare_and_swap(&site->Key, 0, key)) {
+                site->File = File;
+                site->Line = Line;
+                site->Format = Format;
+                site->Lib = Lib;
+                site->Level = Level;
+                __atomic_store_n(&site->Ready, TRUE, __ATOMIC_RELEASE);
+                return site;
+            }
+            k = __atomic_load_n(&site->Key, __ATOMIC_ACQUIRE);
+        }
+        if (k == key) return site;
+    }
+    return NULL;
+}
+
+//! Check if a rate limited message can be logged, counting its occurrence
+static int App_LogSiteAllow(
+    //! [in] Call site entry (NULL if the table is full)
+    TApp_LogSite * const Site,
+    //! [in] Rate limiting bits of the message level (APP_ONCE, APP_EVERY_N, APP_EVERY_SECONDS)
+    const int Rate
+) {
+    //! \return TRUE if the message has to be logged, FALSE if suppressed
+    //! \note When the table is full, messages are not limited
+    TApp_LogSite *site = Site;
+    int           allow;
+
+    if (!site) return TRUE;
+
+    uint64_t count = __sync_fetch_and_add(&site->Count, 1);
+    int      arg = (Rate >> 16) & 0x7FFF;
+
+    if (Rate & APP_ONCE) {
+        allow = count == 0;
+    } else if (Rate & APP_EVERY_N(0)) {
+        allow = arg <= 1 || count % arg == 0;
+    } else {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+        int64_t ms = (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+        int64_t next = __atomic_load_n(&site->Next, __ATOMIC_ACQUIRE);
+
+        // Only one thread gets the slot of a period
+        allow = ms >= next && __sync_bool_compare_and_swap(&site->Next, next, ms + (int64_t)arg * 1000);
+    }
+    if (!allow) __sync_fetch_and_add(&site->Suppressed, 1);
+
+    return allow;
+}
+
+//! Check if the messages of a call site pass the log filter, evaluated once per filter
+static inline int App_LogSiteFilter(
+    //! [in] Call site entry (NULL if the table is full)
+    TApp_LogSite * const Site,
+    //! [in] Source file of the call site (NULL if unknown)
+    const char * const File,
+    //! [in] Source line of the call site
+    const int Line,
+    //! [in] Library id
+    const TApp_Lib Lib,
+    //! [in] printf style format string
+    const char * const Format,
+    //! [in] Variables referrenced in the format string
+    va_list Args
+) {
+    //! \return TRUE if the message has to be logged
+    //! \note Calls without a site of their own (Lib_Log function, Fortran) share their entry with every call of the same
+    //!       format, they and the formats without literal text are matched on the formatted message, see \ref App_LogFilter
+    int filter;
+
+    if (!File) return App_LogFilterMatchV(File, Line, Lib, Format, Args);
+    if (!Site) return App_LogFilterLiteral(Format) ? App_LogFilterMatch(File, Line, Lib, Format) : App_LogFilterMatchV(File, Line, Lib, Format, Args);
+
+    filter = __atomic_load_n(&Site->Filter, __ATOMIC_ACQUIRE);
+    if (filter >> 2 != App->LogFilter) {
+        filter = App->LogFilter << 2 | (App_LogFilterLiteral(Format) ? 0x2 | App_LogFilterMatch(File, Line, Lib, Format) : 0);
+        __atomic_store_n(&Site->Filter, filter, __ATOMIC_RELEASE);
+    }
+    return filter & 0x2 ? filter & 0x1 : App_LogFilterMatchV(File, Line, Lib, Format, Args);
+}
+
+//! Log how many messages were suppressed by the rate limits of each call site
+void App_LogSiteSummary(void) {
+
+    //! \note Called by \ref App_End, the counts are reset once reported
+    for(int n = 0; n < APP_LOGSITE_MAX; n++) {
+        TApp_LogSite *site = &AppLogSites[n];
+        if (!__atomic_load_n(&site->Ready, __ATOMIC_ACQUIRE)) continue;
+
+        uint64_t nb = __atomic_exchange_n(&site->Suppressed, 0, __ATOMIC_ACQ_REL);
+        if (!nb || App->LogLevel[site->Lib] == APP_QUIET || site->Level > App->LogLevel[site->Lib]) continue;
+
+        // Report the format up to its first newline
+        int len = strcspn(site->Format, "\n");
+        (Lib_Log)(site->Lib, APP_VERBATIM, "(%s) %sSuppressed %lu repeats of \"%.*s\" (%s:%d)\n",
+            AppLevelNames[site->Level], AppLibLog[site->Lib], (unsigned long)nb, len, site->Format, site->File ? site->File : "?", site->Line);
+    }
+}
+
+//! Account for the cost of a message
+static void App_LogCostAdd(
+    //! [in] Call site entry (NULL if unknown)
+    TApp_LogSite * const Site,
+    //! [in] Library id
+    const TApp_Lib Lib,
+    //! [in] Record length
+    const int Len,
+    //! [in] Formatting time in nanoseconds
+    const uint64_t Format,
+    //! [in] Write time in nanoseconds
+    const uint64_t Write,
+    //! [in] Lock wait time in nanoseconds
+    const uint64_t Lock
+) {
+    TApp_LogCost *cost[2] = { &AppLogCosts[Lib], Site ? &Site->Cost : NULL };
+
+    for(int c = 0; c < 2 && cost[c]; c++) {
+        __sync_fetch_and_add(&cost[c]->Nb, 1);
+        __sync_fetch_and_add(&cost[c]->Bytes, Len);
+        __sync_fetch_and_add(&cost[c]->Format, Format);
+        __sync_fetch_and_add(&cost[c]->Write, Write);
+        if (Lock) __sync_fetch_and_add(&cost[c]->Lock, Lock);
+    }
+}
+
+//! Configure the log cost accounting
+int App_LogCost(
+    //! [in] Number of most expensive call sites reported in the \ref App_End footer (0: no accounting)
+    const int Top,
+    //! [in] Sum the cost of the libraries over all the ranks (collective in \ref App_End)
+    const int AllRanks
+) {
+    //! \return Previous number of call sites reported
+    //! \note Call sites are only known for messages logged through the \ref Lib_Log macro, other ones are grouped by format string
+    int pt = App->LogCost;
+
+    App->LogCost = Top > 0 ? Top : 0;
+    App->LogCostAll = AllRanks;
+
+    return pt;
+}
+
+//! Sum the cost of the libraries over all the ranks on rank 0 (collective on App->Comm)
+void App_LogCostReduce(void) {
 #ifdef HAVE_MPI
-    if (Level<APP_COLLECT && App->LogRank != -1 && (App->LogRank != App->RankMPI && App->LogRank != App->ComponentRank)) {
+    uint64_t cost[APP_LIBSMAX * 5];
+
+    for(int l = 0; l < APP_LIBSMAX; l++) {
+        cost[l * 5] = AppLogCosts[l].Nb;
+        cost[l * 5 + 1] = AppLogCosts[l].Bytes;
+        cost[l * 5 + 2] = AppLogCosts[l].Format;
+        cost[l * 5 + 3] = AppLogCosts[l].Write;
+        cost[l * 5 + 4] = AppLogCosts[l].Lock;
+    }
+    if (!App->RankMPI) {
+        MPI_Reduce(MPI_IN_PLACE, cost, APP_LIBSMAX * 5, MPI_UINT64_T, MPI_SUM, 0, App->Comm);
+        for(int l = 0; l < APP_LIBSMAX; l++) {
+            AppLogCosts[l].Nb = cost[l * 5];
+            AppLogCosts[l].Bytes = cost[l * 5 + 1];
+            AppLogCosts[l].Format = cost[l * 5 + 2];
+            AppLogCosts[l].Write = cost[l * 5 + 3];
+            AppLogCosts[l].Lock = cost[l * 5 + 4];
+        }
+    } else {
+        MPI_Reduce(cost, NULL, APP_LIBSMAX * 5, MPI_UINT64_T, MPI_SUM, 0, App->Comm);
+    }
+#endif
+}
+
+//! Order call sites by decreasing cost
+static int App_LogCostCompare(const void *A, const void *B) {
+    const TApp_LogSite *a = *(TApp_LogSite* const*)A, *b = *(TApp_LogSite* const*)B;
+    uint64_t ca = a->Cost.Format + a->Cost.Write, cb = b->Cost.Format + b->Cost.Write;
+
+    return ca < cb ? 1 : ca > cb ? -1 : 0;
+}
+
+//! Log the cost of the messages of each library and of the most expensive call sites
+void App_LogCostSummary(void) {
+
+    TApp_LogCost  cost[APP_LIBSMAX];
+    TApp_LogSite *sites[APP_LOGSITE_MAX];
+    int           nb = 0;
+
+    // Take the counts before we add our own messages
+    memcpy(cost, AppLogCosts, sizeof(cost));
+    for(int n = 0; n < APP_LOGSITE_MAX; n++) {
+        if (__atomic_load_n(&AppLogSites[n].Ready, __ATOMIC_ACQUIRE) && AppLogSites[n].Cost.Nb) {
+            sites[nb++] = &AppLogSites[n];
+        }
+    }
+    qsort(sites, nb, sizeof(TApp_LogSite*), App_LogCostCompare);
+
+    App_Log(APP_VERBATIM, "Log cost       : %-10s %10s %12s %10s %10s %10s%s\n", "library", "messages", "bytes", "format(ms)", "write(ms)", "lock(ms)",
+        App->LogCostAll && App->NbMPI > 1 ? " (all ranks)" : "");
+    for(int l = 0; l < APP_LIBSMAX; l++) {
+        if (cost[l].Nb) {
+            App_Log(APP_VERBATIM, "                 %-10s %10lu %12lu %10.3f %10.3f %10.3f\n", AppLibNames[l], (unsigned long)cost[l].Nb, (unsigned long)cost[l].Bytes,
+                cost[l].Format / 1e6, cost[l].Write / 1e6, cost[l].Lock / 1e6);
+        }
+    }
+    for(int n = 0; n < nb && n < App->LogCost; n++) {
+        // Report the format up to its first newline
+        int len = MIN(strcspn(sites[n]->Format, "\n"), 40);
+        App_Log(APP_VERBATIM, "%s%s:%d \"%.*s\" (%s) %lu messages, %lu bytes, %.3f ms format, %.3f ms write, %.3f ms lock\n",
+            n ? "                 " : "Top log sites  : ", sites[n]->File ? sites[n]->File : "?", sites[n]->Line, len, sites[n]->Format, AppLibNames[sites[n]->Lib],
+            (unsigned long)sites[n]->Cost.Nb, (unsigned long)sites[n]->Cost.Bytes, sites[n]->Cost.Format / 1e6, sites[n]->Cost.Write / 1e6, sites[n]->Cost.Lock / 1e6);
+    }
+}
+
+//! Format and dispatch a log entry
+static void App_LogV(
+    //! [in] Source file of the call site (NULL if unknown)
+    const char * const File,
+    //! [in] Source line of the call site
+    const int Line,
+    //! [in] Library id
+    const TApp_Lib Lib,
+    //! [in] Message level. See \ref TApp_LogLevel
+    const TApp_LogLevel Level,
+    //! [in] Log from all ranks, whatever the rank selection (\ref App_LogRank)
+    const int AllRanks,
+    //! [in] printf style format string
+    const char * const Format,
+    //! [in] Variables referrenced in the format string
+    va_list Args
+) {
+    pid_t tid=0;
+    int deferred = FALSE;
+    int rate = Level >= 0 ? Level & APP_LOGRATE_MASK : 0;
+    TApp_LogLevel level = Level & ~rate;
+
+    // Fast exit for messages discarded without side effect (see Lib_LogEnabled), unless kept by the flight recorder
+    if (level > APP_WARNING && level <= APP_EXTRA && level > App->LogLevel[Lib]) {
+        if (level <= App->LogRecorder) App_LogRecorderKeep(Lib, level, Format, Args);
+        return;
+    }
+
+    if (App->LogThread || App->LogFormat == APP_LOG_JSON) {
+       tid = App_LogTid();
+    }
+
+#ifdef HAVE_MPI
+    if (level<APP_COLLECT && !AllRanks && App->LogRank != -1 && !App->LogRankOn) {
         return;
     }
 
     // If in collect mode, we collect the minimal error to 
-    if (Level>=APP_COLLECT) {
-        level=Level-APP_COLLECT;
-        MPI_Allreduce(MPI_IN_PLACE, &level, 1, MPI_INT, MPI_MIN, App->Comm);
+    if (level>=APP_COLLECT) {
+        level-=APP_COLLECT;
+        if (App->LogCollect) {
+            // Kept until the next checkpoint, unless this is the agreed message being logged
+            deferred = TRUE;
+            level = App_LogCollectDefer(Lib, level, Format, Args);
+        } else {
+            MPI_Allreduce(MPI_IN_PLACE, &level, 1, MPI_INT, MPI_MIN, App->Comm);
+        }
 
         if (level==APP_QUIET) return;
     }
@@ -1198,16 +2096,12 @@ void Lib_Log(
 
     if (!App->LogStream) App_LogOpen();
 
-    // Check for once log flag
-    int effectiveLevel = level;
-
-    if (effectiveLevel > APP_QUIET) {
-        // If we logged it at least once
-        if (effectiveLevel >> 3 < APP_MAXONCE && App_OnceTable[effectiveLevel >> 3]++) return;
+    // Check the call site log filter and rate limit
+    const int effectiveLevel = level;
+    TApp_LogSite *site = rate || App->LogCost || App->LogFilter ? App_LogSiteGet(File, Line, Lib, effectiveLevel, Format) : NULL;
 
-        // Real log level
-        effectiveLevel &= 0x7;
-    }
+    if (App->LogFilter && effectiveLevel > APP_WARNING && effectiveLevel <= APP_EXTRA && !App_LogSiteFilter(site, File, Line, Lib, Format, Args)) return;
+    if (rate && !App_LogSiteAllow(site, rate)) return;
 
     App_TimerStart(App->TimerLog);
 
@@ -1221,101 +2115,53 @@ void Lib_Log(
     if (effectiveLevel <= App->LogLevel[Lib]) {
         char prefix[256];
         prefix[0] = '\0';
-        if (effectiveLevel >= APP_ALWAYS) {
-
-            char *color = App->LogColor ? AppLevelColors[effectiveLevel] : AppLevelColors[APP_INFO];
-            char time[32];
-
-            if (App->LogTime) {
-                struct timeval now;
-                gettimeofday(&now, NULL);
-
-                struct tm *lctm;
-                struct timeval diff;
-                switch(App->LogTime) {
-                case APP_DATETIME:
-                    lctm = App->UTC ? gmtime(&now.tv_sec) : localtime(&now.tv_sec);
-                    strftime(time, 32, "%c ", lctm);
-                    break;
-                case APP_TIME:
-                    timersub(&now, &App->Time, &diff);
-                    lctm = App->UTC ? gmtime(&diff.tv_sec) : localtime(&diff.tv_sec);
-                    strftime(time, 32, "%T ", lctm);
-                    break;
-                case APP_SECOND:
-                    timersub(&now, &App->Time, &diff);
-                    snprintf(time, 32, "%-8.3f ", diff.tv_sec + diff.tv_usec / 1000000.0);
-                    break;
-                case APP_MSECOND:
-                    timersub(&now, &App->Time, &diff);
-                    snprintf(time, 32, "%-8li ", diff.tv_sec * 1000 + diff.tv_usec / 1000);
-                    break;
-                case APP_NODATE:
-                    break;
-                }
-            } else {
-                time[0] = '\0';
-            }
-
-#ifdef HAVE_MPI
-            if (App_IsMPI() && App->LogRank == -1 && !App->LogSplit) {
-                if (App->Step) {
-                    if (App->LogThread) {
-                        sprintf(prefix, "%s%sP%03dT%03d (%s) #%d %s", color, time, App->RankMPI, tid, AppLevelNames[effectiveLevel], App->Step, AppLibLog[Lib]);
-                    } else {
-                        sprintf(prefix, "%s%sP%03d (%s) #%d %s", color, time, App->RankMPI, AppLevelNames[effectiveLevel], App->Step, AppLibLog[Lib]);
-                    }
-                } else {
-                    if (App->LogThread) {
-                        sprintf(prefix, "%s%sP%03dT%03d (%s) %s", color, time, App->RankMPI, tid, AppLevelNames[effectiveLevel], AppLibLog[Lib]);
-                    } else {
-                        sprintf(prefix, "%s%sP%03d (%s) %s", color, time, App->RankMPI, AppLevelNames[effectiveLevel], AppLibLog[Lib]);
-                    }
-                }
-            }
-            else
-#endif
-            if (App->Step) {
-                if (App->LogThread) {
-                   sprintf(prefix, "%s%sT%03d (%s) #%d %s", color, time, tid, AppLevelNames[effectiveLevel], App->Step, AppLibLog[Lib]);                  
-                } else {
-                   sprintf(prefix, "%s%s(%s) #%d %s", color, time, AppLevelNames[effectiveLevel], App->Step, AppLibLog[Lib]);
-                }
-            } else {
-                if (App->LogThread) {
-                    sprintf(prefix, "%s%sT%03d (%s) %s", color, time, tid, AppLevelNames[effectiveLevel], AppLibLog[Lib]); 
-                } else {
-                    sprintf(prefix, "%s%s(%s) %s", color, time, AppLevelNames[effectiveLevel], AppLibLog[Lib]);
-                }
-            }
+        if (effectiveLevel >= APP_ALWAYS && App->LogFormat == APP_LOG_TEXT) {
+            App_LogPrefix(prefix, Lib, effectiveLevel, tid, AllRanks);
         }
 
-        va_list args;
-
-        pthread_mutex_lock(&App_mutex);
-        {
-            fprintf(App->LogStream, "%s", prefix);
-
-            va_start(args, Format);
-            vfprintf(App->LogStream, Format, args);
-            va_end(args);
+        va_list  args;
+        char    *rec = App_LogBuf;
+        int      len;
+        uint64_t t0 = App->LogCost ? App_LogCostNow() : 0, lock = 0;
+
+        va_copy(args, Args);
+        if (App->LogFormat == APP_LOG_BINARY) {
+            // Deferred formatting, only the raw arguments are written
+            len = App_LogBinaryRecord(&rec, Lib, effectiveLevel, tid, Format, args);
+        } else if (App->LogFormat == APP_LOG_JSON) {
+            // One JSON object per line
+            len = App_LogJSONRecord(&rec, Lib, effectiveLevel, tid, Format, args);
+        } else {
+            // Format the whole record outside of any lock, it is written at once
+            len = App_LogRecord(prefix, Format, args);
+            rec = App_LogBuf;
+        }
+        va_end(args);
 
-            if (App->LogColor) {
-                fprintf(App->LogStream, APP_COLOR_RESET);
+        if (len >= 0) {
+            if (App->LogCost) {
+                uint64_t t1 = App_LogCostNow();
+                App_LogEmit(rec, len, effectiveLevel, &lock);
+                App_LogCostAdd(site, Lib, len, t1 - t0, App_LogCostNow() - t1, lock);
+            } else {
+                App_LogEmit(rec, len, effectiveLevel, NULL);
             }
 
-            // Force flush on error, when using colors or if APP_LOG_FLUSH flush is defined
-            if (App->LogFlush || App->LogColor || effectiveLevel == APP_ERROR || effectiveLevel == APP_FATAL || effectiveLevel == APP_SYSTEM) {
-                fflush(App->LogStream);
+            // On errors, save for extenal to use (ex: Tcl)
+            if (App->LogFormat == APP_LOG_TEXT && (effectiveLevel == APP_ERROR || effectiveLevel == APP_FATAL || effectiveLevel == APP_SYSTEM)) {
+                int plen = strlen(prefix);
+                int rlen = App->LogColor ? strlen(APP_COLOR_RESET) : 0;
+                snprintf(APP_LASTERROR, APP_ERRORSIZE, "%.*s", len - plen - rlen, App_LogBuf + plen);
             }
         }
-        pthread_mutex_unlock(&App_mutex);
 
         if (effectiveLevel == APP_ERROR || effectiveLevel == APP_FATAL || effectiveLevel == APP_SYSTEM) {
-            // On errors, save for extenal to use (ex: Tcl)
-            va_start(args, Format);
-            vsnprintf(APP_LASTERROR, APP_ERRORSIZE, Format, args);
-            va_end(args);
+            // On errors, save for extenal to use (ex: Tcl), text records already did
+            if (App->LogFormat != APP_LOG_TEXT) {
+                va_copy(args, Args);
+                vsnprintf(APP_LASTERROR, APP_ERRORSIZE, Format, args);
+                va_end(args);
+            }
 
             // On system error
             if (effectiveLevel == APP_SYSTEM) {
@@ -1325,12 +2171,84 @@ void Lib_Log(
     }
     App_TimerStop(App->TimerLog);
 
-    // Exit application if error above tolerance level
-    if (App->Tolerance <= effectiveLevel && (effectiveLevel == APP_FATAL || effectiveLevel == APP_SYSTEM || effectiveLevel == APP_ERROR)) {
+    // Ship aggregated records if due, errors right away
+    if (App->LogAggregate) {
+        App_LogAggregateFlush(effectiveLevel == APP_ERROR || effectiveLevel == APP_FATAL || effectiveLevel == APP_SYSTEM);
+    }
+    if (App->LogMPIIO) {
+        App_LogMPIIOFlush(effectiveLevel == APP_ERROR || effectiveLevel == APP_FATAL || effectiveLevel == APP_SYSTEM);
+    }
+
+    // Exit application if error above tolerance level, deferred collective errors exit at the checkpoint on all ranks
+    if (!deferred && App->Tolerance <= effectiveLevel && (effectiveLevel == APP_FATAL || effectiveLevel == APP_SYSTEM || effectiveLevel == APP_ERROR)) {
+        App_LogRecorderDump(FALSE);
         App_End(APP_EXIT+effectiveLevel);
     }
 }
 
+//! Add log entry
+void Lib_Log(
+    //! [in] Library id
+    const TApp_Lib Lib,
+    //! [in] Message level. See \ref TApp_LogLevel
+    const TApp_LogLevel Level,
+    //! [in] printf style format string
+    const char * const Format,
+    //! [in] Variables referrenced in the format string
+    ...
+) {
+    //! \note If level is ERROR, the message will be written on stderr, for all other levels the message will be written to stdout or the log file
+    //! \note If level is APP_FATAL or APP_SYSTEM, and APP_TOLERANCE is set to either of those, the application will exit, optionnally calling the finalize callback if define
+    //! \note If adding APP_COLLECT (ie: APP_FATAL+APP_COLLECT) to the message level, an MPI collective call will be made to get the lowest error level through all PEs (and potentially exit depending on previous point)
+    //! \note Rate limited messages (APP_ONCE, APP_EVERY_N, APP_EVERY_SECONDS) are keyed by their format string only, see \ref Lib_LogSite
+
+    va_list args;
+
+    va_start(args, Format);
+    App_LogV(NULL, 0, Lib, Level, FALSE, Format, args);
+    va_end(args);
+}
+
+//! Add log entry from a known call site, used by the \ref Lib_Log macro
+void Lib_LogSite(
+    //! [in] Source file of the call site
+    const char * const File,
+    //! [in] Source line of the call site
+    const int Line,
+    //! [in] Library id
+    const TApp_Lib Lib,
+    //! [in] Message level. See \ref TApp_LogLevel
+    const TApp_LogLevel Level,
+    //! [in] printf style format string
+    const char * const Format,
+    //! [in] Variables referrenced in the format string
+    ...
+) {
+    va_list args;
+
+    va_start(args, Format);
+    App_LogV(File, Line, Lib, Level, FALSE, Format, args);
+    va_end(args);
+}
+
+//! Add log entry from all ranks, whatever the rank selection (used from Fortran)
+static void Lib_LogAllRanks(
+    //! [in] Library id
+    const TApp_Lib Lib,
+    //! [in] Message level. See \ref TApp_LogLevel
+    const TApp_LogLevel Level,
+    //! [in] printf style format string
+    const char * const Format,
+    //! [in] Variables referrenced in the format string
+    ...
+) {
+    va_list args;
+
+    va_start(args, Format);
+    App_LogV(NULL, 0, Lib, Level, TRUE, Format, args);
+    va_end(args);
+}
+
 
 //! Print progress message
 void App_Progress(
@@ -1346,6 +2264,20 @@ void App_Progress(
 
     if (!App->LogStream) App_LogOpen();
 
+    // Binary and JSON logs can not hold raw text
+    if (App->LogFormat != APP_LOG_TEXT) {
+        char msg[APP_ERRORSIZE];
+        va_list args;
+        va_start(args, Format);
+        vsnprintf(msg, APP_ERRORSIZE, Format, args);
+        va_end(args);
+        Lib_Log(APP_MAIN, APP_VERBATIM, "(PROGRESS) [%6.2f %%] %s", App->Percent, msg);
+        return;
+    }
+
+    // Keep progress messages in sequence with the asynchronous records
+    App_LogAsyncFlush();
+
     fprintf(App->LogStream, "%s(PROGRESS) [%6.2f %%] ", (App->LogColor?APP_COLOR_MAGENTA:""), App->Percent);
     va_list args;
     va_start(args, Format);
@@ -1444,6 +2376,26 @@ int App_LogLevelNo(
 }
 
 
+//! Set the model step, which is a step boundary for the MPI-IO log file
+int App_LogStep(
+    //! [in] New step
+    const int Step
+) {
+    //! \return Previous step
+    //! \note Collective on App->Comm when the MPI-IO log file is used (APP_LOG_MPIIO), the records of the step are written then,
+    //! or when the collective messages are deferred (APP_LOG_COLLECT), the agreement on the previous step is completed then.
+    //! When aggregating (APP_LOG_AGGREGATE), node heads receive and forward the records of their node then
+    const int old_step = App->Step;
+
+    App->Step = Step;
+    App_LogCollectSync(FALSE);
+    App_LogMPIIOSync();
+    App_LogAggregateFlush(FALSE);
+
+    return old_step;
+}
+
+
 //! Set the rank of the MPI process that will display messages
 int App_LogRank(
     //! [in] Rank of the MPI process that should display messages. -1 for all processes.
@@ -1452,12 +2404,121 @@ int App_LogRank(
     const int old_rank = App->LogRank;
     if (NewRank >= -1 && NewRank < App->NbMPI) {
         App->LogRank = NewRank;
+        App_LogRankSelect();
     }
-    //! \return Rank of the old MPI process that displayed the messages
+    //! \return Rank of the old MPI process that displayed the messages (APP_LOGRANK_SET if selected by \ref App_LogRanks)
     return old_rank;
 }
 
 
+//! Check if a rank matches a rank selection
+static int App_LogRankMatch(
+    //! [in] Rank selection (see \ref App_LogRanks)
+    const char * const Ranks,
+    //! [in] Rank within App->Comm
+    const int Rank
+) {
+    //! \return TRUE if the rank is selected, FALSE if not, -1 if the selection is invalid
+    char  spec[APP_BUFMAX], *tok, *save = NULL, *end;
+    long  first, last, stride;
+    int   match = FALSE;
+
+    strncpy(spec, Ranks, APP_BUFMAX - 1);
+    spec[APP_BUFMAX - 1] = '\0';
+
+    for(tok = strtok_r(spec, ", ", &save); tok; tok = strtok_r(NULL, ", ", &save)) {
+        if (strcasecmp(tok, "ALL") == 0) {
+            match = TRUE;
+        } else if (strcasecmp(tok, "NODE") == 0) {
+            // Head of each node
+            match |= App->NodeRankMPI == 0;
+        } else if (strcasecmp(tok, "COMPONENT") == 0) {
+            // Rank 0 of each MPMD component
+#ifdef HAVE_MPI
+            match |= App->ComponentRank >= 0 ? App->ComponentRank == 0 : Rank == 0;
+#else
+            match |= Rank == 0;
+#endif
+        } else {
+            // [first][-[last]][/stride]
+            first = 0;
+            last = LONG_MAX;
+            stride = 1;
+            end = tok;
+            if (*end != '-' && *end != '/') {
+                first = last = strtol(tok, &end, 10);
+                if (end == tok || first < 0) return -1;
+            }
+            if (*end == '-') {
+                tok = end + 1;
+                last = strtol(tok, &end, 10);
+                if (end == tok) last = LONG_MAX;
+            }
+            if (*end == '/') {
+                tok = end + 1;
+                stride = strtol(tok, &end, 10);
+                if (end == tok || stride <= 0) return -1;
+            }
+            if (*end != '\0' || last < first) return -1;
+
+            match |= Rank >= first && Rank <= last && (Rank - first) % stride == 0;
+        }
+    }
+    return match;
+}
+
+
+//! Select the ranks allowed to log
+int App_LogRanks(
+    //! [in] Comma separated list of ranks (5), ranges (0-15, 8-), strides (0-63/8, /100), NODE (head of each node),
+    //! COMPONENT (rank 0 of each MPMD component), ALL, or a single rank as in \ref App_LogRank (-1 for all)
+    const char * const Ranks
+) {
+    //! \return APP_OK, or APP_ERR if the selection is invalid
+    //! \note The selection is evaluated once for this process (\ref App_LogRankSelect), not at every message.
+    //! NODE needs the node grouping (\ref App_NodeGroup), done by \ref App_Start, or here once started (then collective on App->Comm)
+    char *end;
+    long  rank;
+
+    if (!Ranks) return APP_ERR;
+
+    rank = strtol(Ranks, &end, 10);
+    if (end != Ranks && *end == '\0') {
+        if (rank < -1) return APP_ERR;
+        App->LogRank = rank;
+    } else {
+        if (App_LogRankMatch(Ranks, 0) < 0) return APP_ERR;
+        free(App->LogRanks);
+        App->LogRanks = strdup(Ranks);
+        App->LogRank = APP_LOGRANK_SET;
+#ifdef HAVE_MPI
+        // Once started, the node grouping is done here (collective on App->Comm)
+        if (App->State == APP_RUN && App->NodeComm == MPI_COMM_NULL && strcasestr(Ranks, "NODE")) {
+            App_NodeGroup();
+        }
+#endif
+    }
+    App_LogRankSelect();
+
+    return APP_OK;
+}
+
+
+//! Evaluate if this process is allowed to log
+void App_LogRankSelect(void) {
+    //! \note To be called when the rank, node or component of the process changes
+#ifdef HAVE_MPI
+    if (App->LogRank == APP_LOGRANK_SET) {
+        App->LogRankOn = App_LogRankMatch(App->LogRanks, App->RankMPI) > 0;
+    } else {
+        App->LogRankOn = App->LogRank == -1 || App->LogRank == App->RankMPI || App->LogRank == App->ComponentRank;
+    }
+#else
+    App->LogRankOn = TRUE;
+#endif
+}
+
+
 //! Set the log level
 int Lib_LogLevelNo(
     //! [in] Library id
@@ -1555,6 +2616,30 @@ int App_LogTime(
 }
 
 
+//! Set log output format
+int App_LogFormat(
+    //! [in] Log format ("TEXT", "BINARY", "JSON")
+    const char * const Format
+) {
+    int pf = App->LogFormat;
+
+    if (Format) {
+        if (strcasecmp(Format, "TEXT") == 0) {
+            App->LogFormat = APP_LOG_TEXT;
+        } else if (strcasecmp(Format, "BINARY") == 0) {
+            App->LogFormat = APP_LOG_BINARY;
+        } else if (strcasecmp(Format, "JSON") == 0) {
+            App->LogFormat = APP_LOG_JSON;
+        } else {
+            App->LogFormat = (TApp_LogFormat)atoi(Format);
+        }
+    }
+
+    //! \return Previous log format
+    return pf;
+}
+
+
 //! Print arguments information
 void App_PrintArgs(
     //! [in] Arguments definition
@@ -5,6 +5,7 @@
 //! Interface of the App library
 
 #include <stdio.h>
+#include <stdarg.h>
 #include <sys/time.h>
 
 #include "App_Atomic.h"
@@ -48,6 +49,8 @@
 #define APP_LISTMAX   4096                ///< Maximum number of items in a flag list
 #define APP_SEED      1049731793          ///< Initial FIXED seed
 #define APP_LIBSMAX   64                  ///< Maximum number of libraries
+#define APP_LIBNAMEMAX 32                 ///< Maximum length of the name of a library registered at run time
+#define APP_LOGRANK_SET -2                ///< App->LogRank when the ranks allowed to log are selected by App->LogRanks
 
 #define APP_NOARGSFLAG 0x00               ///< No flag specified
 #define APP_NOARGSFAIL 0x01               ///< Fail if no arguments are specified
@@ -57,19 +60,17 @@
 #define APP_ARGSTHREAD 0x10               ///< Use thread flag
 #define APP_ARGSTMPDIR 0x20               ///< Use tmp dir
 
-#ifdef __xlC__
-#   define APP_ONCE    ((1)<<3)
-#else
-#   define APP_ONCE    ((__COUNTER__+1)<<3)
-#endif
-#define APP_MAXONCE 1024
+//! Call site rate limiting, added to a message level (ie: APP_WARNING|APP_ONCE)
+#define APP_ONCE               0x1000                                ///< Log only the first occurrence
+#define APP_EVERY_N(N)         (0x2000 | (((N) & 0x7FFF) << 16))     ///< Log one occurrence out of N
+#define APP_EVERY_SECONDS(T)   (0x4000 | (((T) & 0x7FFF) << 16))     ///< Log at most one occurrence every T seconds
+#define APP_LOGRATE_MASK       0x7FFF7000                            ///< Rate limiting bits of a message level
+#define APP_LOGSITE_MAX        4096                                  ///< Maximum number of rate limited or accounted call sites
 
 //! Maximum component lane length (including null character)
 #define APP_MAX_COMPONENT_NAME_LEN 32
 
-//! List of known libraries
-//! \todo Remove this static list; it makes no sense: this library must be modified to add new clients apps/libs!
-//! The library must not be aware of its users!
+//! List of known libraries, others are added at run time with \ref App_LibRegisterDynamic (up to APP_LIBSMAX)
 typedef enum {
     //! Main application
     APP_MAIN = 0,
@@ -133,6 +134,19 @@ typedef enum {
    APP_STAT_CPU      = 0x08
 } TApp_Stats;
 
+//! Asynchronous log writer policy when a thread ring is full
+typedef enum {
+    APP_LOGASYNC_BLOCK = 0,
+    APP_LOGASYNC_DROP = 1
+} TApp_LogAsyncPolicy;
+
+//! Log output format
+typedef enum {
+    APP_LOG_TEXT = 0,
+    APP_LOG_BINARY = 1,
+    APP_LOG_JSON = 2
+} TApp_LogFormat;
+
 //! Log date detail level
 typedef enum {
     APP_NODATE = 0,
@@ -310,10 +324,28 @@ typedef struct {
    char*          LogFile;               ///< Log file
    int            LogSplit;              ///< Split the log file per MPI rank path
    int            LogFlush;              ///< Forche buffer flush at every message
+   int            LogAsync;              ///< Asynchronous writer ring size per thread in bytes (0=synchronous)
+   TApp_LogAsyncPolicy LogAsyncPolicy;   ///< Asynchronous writer policy when a ring is full
+   TApp_LogFormat LogFormat;             ///< Log output format (text, binary, json)
+   int            LogAggregate;          ///< Number of aggregated log writer ranks (0=every rank writes)
+   int            LogShared;             ///< Intra-node shared memory log ring size in bytes (0=every rank writes)
+   int            LogMPIIO;              ///< MPI-IO shared log file buffer size in bytes (0=every rank writes)
+   int64_t        LogRotate;             ///< Log file segment size in bytes (0=single file)
+   int            LogRotateNb;           ///< Maximum number of log file segments kept (0=all)
+   int            LogCompress;           ///< Compress the log file segments (gzip)
+   int64_t        LogMmap;               ///< Memory mapped log file extension chunk size in bytes (0=stdio writer)
+   TApp_LogLevel  LogRecorder;           ///< Flight recorder level (0=disabled)
+   int            LogRecorderSize;       ///< Flight recorder ring size per thread in bytes
+   int            LogCost;               ///< Number of call sites reported by the log cost accounting (0=no accounting)
+   int            LogCostAll;            ///< Sum the log cost accounting of the libraries over all ranks
+   int            LogCollect;            ///< Defer the agreement on collective (APP_COLLECT) messages to the checkpoints
+   int            LogFilter;             ///< Log filter generation (0=no filter), see App_LogFilter
    char*          Tag;                   ///< Identificateur
    FILE*          LogStream;             ///< Log file associated stream
    int            LogNoBox;              ///< Display header and footer boxes
-   int            LogRank;               ///< Force log from a single rank
+   int            LogRank;               ///< Force log from a single rank (-1: all ranks, APP_LOGRANK_SET: ranks selected by LogRanks)
+   char*          LogRanks;              ///< Selection of the ranks allowed to log (lists, ranges, strides, NODE, COMPONENT)
+   int            LogRankOn;             ///< This process is selected to log (precomputed from LogRank or LogRanks)
    int            LogThread;             ///< Display thread id
    int            LogWarning;            ///< Number of warnings
    int            LogError;              ///< Number of errors
@@ -361,6 +393,7 @@ typedef struct {
 #endif //HAVE_MPI
 
    TApp_Timer     *TimerLog;             ///< Time spent on log printing
+   char           *TimerClock;           ///< Clock of the timers (TSC, MONOTONIC), set by App_Start
    int32_t        (*Finalize)(void);     ///< Application specific finalization function
 } TApp;
 
@@ -371,6 +404,27 @@ static inline char* App_TimeString(TApp_Timer *Timer,int Total) {
     snprintf(Timer->String,32,"%s%.3f ms%s",(App->LogColor?APP_COLOR_LIGHTGREEN:""),(Total?App_TimerTotalTime_ms(Timer):App_TimerLatestTime_ms(Timer)),(App->LogColor?APP_COLOR_RESET:""));
     return(Timer->String);
 }
+
+//! Check if a message of a given level would be processed by \ref Lib_Log
+static inline int Lib_LogEnabled(
+    //! [in] Library id
+    const TApp_Lib Lib,
+    //! [in] Message level
+    const int Level
+) {
+    //! \return FALSE only if the message would be discarded without any side effect
+    //! \note Warnings and errors are always processed (counters, tolerance), as are collective (APP_COLLECT) messages.
+    //! Rate limiting flags (APP_ONCE, APP_EVERY_N, APP_EVERY_SECONDS) are ignored, a disabled message is not counted as an occurrence.
+    //! Messages within the flight recorder level are processed (recorded).
+    //! For a constant level, this is a single load and compare, a second one for disabled messages
+    //! When built with APP_LOG_MIN_LEVEL (ie: APP_INFO), less important messages are always discarded, even by the flight recorder
+    const int level = Level < 0 ? Level : Level & ~APP_LOGRATE_MASK;
+#ifdef APP_LOG_MIN_LEVEL
+    // Compiled out below the build threshold, along with the arguments and format string of a constant level call
+    if (level > APP_WARNING && level <= APP_EXTRA && level > APP_LOG_MIN_LEVEL) return FALSE;
+#endif
+    return level <= APP_WARNING || level > APP_EXTRA || level <= App->LogLevel[Lib] || level <= App->LogRecorder;
+}
 #endif
 
 typedef int (TApp_InputParseProc) (void *Def, char *Token, char *Value, int Index);
@@ -387,12 +441,20 @@ typedef int (TApp_InputParseProc) (void *Def, char *Token, char *Value, int Inde
 TApp *App_Init(const int Type, const char * const Name, const char * const Version, const char * const Desc, const char * const Stamp);
 TApp* App_GetInstance(void);
 void  App_LibRegister(const TApp_Lib Lib, const char * const Version);
+TApp_Lib App_LibRegisterDynamic(const char * const Name, const char * const Version);
 void  App_Free(void);
 void  App_Start(void);
 int   App_End(int Status);
 int   App_FinalizeCallback(int32_t (*func)(void));
 int   App_LogStats(const char * const Tag);
 void  Lib_Log(const TApp_Lib lib, const TApp_LogLevel level, const char * const format, ...);
+void  Lib_LogSite(const char * const File, const int Line, const TApp_Lib Lib, const TApp_LogLevel Level, const char * const Format, ...);
+int   Lib_LogEnabled4Fortran(const TApp_Lib Lib, const int Level);
+void  Lib_LogN4Fortran(const TApp_Lib Lib, const TApp_LogLevel Level, const char * const Message, const int Len, const int AllRanks);
+int   App_LogCost(const int Top, const int AllRanks);
+int   App_LogFilter(const char * const Filter);
+int   App_LogCollect(const int Defer);
+void  App_LogCollectSync(const int Wait);
 int   Lib_LogLevel(const TApp_Lib Lib, const char * const Val);
 int   Lib_LogLevelNo(TApp_Lib Lib, TApp_LogLevel Val);
 void  App_LogStream(const char * const Stream);
@@ -402,8 +464,23 @@ int   App_ToleranceLevel(const char * const Level);
 int   App_ToleranceNo(TApp_LogLevel Val);
 void  App_LogOpen(void);
 void  App_LogClose(void);
+int   App_LogAsync(const int Size, const TApp_LogAsyncPolicy Policy);
+void  App_LogAsyncFlush(void);
+void  App_LogAsyncStop(void);
 int   App_LogTime(const char * const Val);
 int   App_LogRank(const int NewRank);
+int   App_LogRanks(const char * const Ranks);
+void  App_LogRankSelect(void);
+int   App_LogAggregate(const int Writers, const int Size, const int Delay);
+int   App_LogShared(const int Size);
+int   App_LogMPIIO(const int Size);
+int   App_LogRotate(const int64_t Size, const int Count, const int Compress);
+int64_t App_LogMmap(const int64_t Size);
+int   App_LogRecorder(const char * const Level, const int Size);
+void  App_LogRecorderDump(const int Crash);
+int   App_LogStep(const int Step);
+int   App_LogFormat(const char * const Format);
+int   App_LogDecode(const char * const File, FILE *Out, const int Rank, const char * const Level, const char * const Lib);
 void  App_Progress(const float Percent, const char * const Format, ...);
 int   App_ParseArgs(TApp_Arg *AArgs, int argc, char *argv[], int Flags);
 int   App_ParseInput(void *Def, char *File, TApp_InputParseProc *ParseProc);
@@ -438,6 +515,13 @@ int   App_NodePrint();
 int   App_GetSS(int64_t *RSS,int64_t *PSS,int64_t *USS);
 int   App_GetCPU(int32_t *Freq,int32_t *Numa,int32_t *Core,int32_t *TempMin,int32_t *TempMax);
 
+#ifndef APP_BUILD
+//! Skip disabled messages inline, without evaluating the arguments.
+//! Messages are keyed by their call site for the rate limits (APP_ONCE, APP_EVERY_N, APP_EVERY_SECONDS) and the cost accounting.
+//! LIB and LEVEL are evaluated more than once. Use (Lib_Log)(...) to call the function directly.
+#define Lib_Log(LIB, LEVEL, ...) (Lib_LogEnabled(LIB, LEVEL) ? Lib_LogSite(__FILE__, __LINE__, LIB, LEVEL, __VA_ARGS__) : (void)0)
+#endif
+
 #ifdef HAVE_MPI
 void App_SetMPIComm(MPI_Comm Comm);
 int App_MPIProcCmp(const void *a, const void *b);
@@ -0,0 +1,71 @@
+#ifndef _App_Log_h
+#define _App_Log_h
+
+//! \file
+//! Internals shared by App.c and the log backends (App_Log*.c), not installed
+//! Included after App.h, the configuration calls of the backends are in App.h
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <pthread.h>
+
+extern pthread_mutex_t App_mutex;      ///< Log and initialization lock, held while writing to App->LogStream
+extern char* AppLibNames[];            ///< Library names (lower case), see App_LibRegisterDynamic
+extern char* AppLibLog[];              ///< Library log prefixes (upper case name followed by '|')
+extern char* AppLevelNames[];          ///< Level names
+
+// Log stream and call sites (App.c)
+FILE* App_LogFileOpen(const char * const File, const char * const Mode);
+void  App_LogSiteSummary(void);
+void  App_LogCostReduce(void);
+void  App_LogCostSummary(void);
+
+// Filter (App_LogFilter.c)
+int   App_LogFilterMatch(const char * const File, const int Line, const TApp_Lib Lib, const char * const Format);
+int   App_LogFilterMatchV(const char * const File, const int Line, const TApp_Lib Lib, const char * const Format, va_list Args);
+int   App_LogFilterLiteral(const char * const Format);
+
+// Deferred collective messages (App_LogCollect.c)
+int   App_LogCollectDefer(const TApp_Lib Lib, const TApp_LogLevel Level, const char * const Format, va_list Args);
+void  App_LogCollectEnd(const int Collective);
+
+// Asynchronous writer (App_LogAsync.c)
+int   App_LogAsyncStart(FILE *Stream);
+int   App_LogAsyncPush(const char *Rec, size_t Len);
+
+// Node aggregation (App_LogAggregate.c)
+int   App_LogAggregateInit(void);
+FILE* App_LogAggregateOpen(int *Owner);
+void  App_LogAggregateFlush(const int Force);
+void  App_LogAggregateEnd(const int Collective);
+
+// Node shared memory ring (App_LogShared.c)
+int   App_LogSharedInit(void);
+FILE* App_LogSharedOpen(void);
+int   App_LogSharedPush(const char *Rec, size_t Len, const int Wait);
+void  App_LogSharedEnd(const int Collective);
+
+// MPI-IO shared file (App_LogMPIIO.c)
+int   App_LogMPIIOInit(void);
+FILE* App_LogMPIIOOpen(void);
+void  App_LogMPIIOFlush(const int Force);
+int   App_LogMPIIOSync(void);
+void  App_LogMPIIOEnd(const int Collective);
+
+// File backends (App_LogRotate.c, App_LogMmap.c)
+FILE* App_LogRotateOpen(const char * const File, const char * const Mode);
+void  App_LogRotateHold(const int Hold);
+FILE* App_LogMmapOpen(const char * const File, const char * const Mode);
+int   App_LogMmapPush(const char *Rec, size_t Len);
+
+// Flight recorder (App_LogRecorder.c)
+void  App_LogRecorderPush(const char *Rec, size_t Len);
+void  App_LogRecorderStream(FILE *Stream);
+
+// Record formats (App_LogBinary.c, App_LogJSON.c)
+void  App_LogBinaryHeader(FILE *Stream);
+int   App_LogBinaryRecord(char **Rec, const TApp_Lib Lib, const TApp_LogLevel Level, const int Thread, const char * const Format, va_list Args);
+size_t App_LogJSONEscape(char *Out, const char *Str, size_t Len);
+int   App_LogJSONRecord(char **Rec, const TApp_Lib Lib, const TApp_LogLevel Level, const int Thread, const char * const Format, va_list Args);
+
+#endif
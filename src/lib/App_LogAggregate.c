@@ -0,0 +1,447 @@
+//! \file
+//! Collective log aggregation
+//!
+//! When enabled (APP_LOG_AGGREGATE), only a few writer ranks open the log file. Every other rank
+//! writes its records into a memory stream that is shipped to its node head over the node
+//! communicator, and node heads forward their node's records to the writer of their group.
+//! Each writer produces one file (APP_LOG_STREAM for a single writer, APP_LOG_STREAM.<writer rank>
+//! otherwise) where records of a given rank are kept in order and tagged with the rank (P000).
+//! Shipping is done by the thread that initialized the aggregation, when the buffer exceeds its
+//! size or the flush delay is elapsed, and on error messages. Both are only checked when the rank
+//! logs and at every \ref App_LogStep, the delay is not a time bound: the last records of a rank
+//! that stops logging are shipped at the next step. Records still in flight are collected
+//! collectively by \ref App_End, the records logged after it go to stderr.
+//! Node heads receive from a progress thread when MPI provides MPI_THREAD_MULTIPLE, otherwise when they log
+//! and at every \ref App_LogStep. A rank whose batch is still in flight keeps at most twice the buffer size
+//! of records, whole lines over it are dropped and their number reported in the log.
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "App.h"
+#include "App_Log.h"
+#include "str.h"
+
+#define APP_LOGAGG_SIZE     (256*1024)          ///< Default buffer size before shipping
+#define APP_LOGAGG_DELAY    1000                ///< Default delay between shipping (ms)
+#define APP_LOGAGG_TAGDATA  0x4C41              ///< Tag of record batches
+#define APP_LOGAGG_TAGEND   0x4C45              ///< Tag of the end of records of a rank
+#define APP_LOGAGG_POLL     10                  ///< Polling delay of the node head progress thread (ms)
+
+typedef enum {
+   APP_LOGAGG_OFF = 0,                          ///< Not aggregating
+   APP_LOGAGG_ON = 1,                           ///< Aggregating
+   APP_LOGAGG_DONE = 2                          ///< Aggregation is over, late records go to stderr
+} TApp_LogAggState;
+
+static int              AppLogAggSize = APP_LOGAGG_SIZE;     ///< Buffer size before shipping
+static int              AppLogAggDelay = APP_LOGAGG_DELAY;   ///< Delay between shipping (ms)
+static TApp_LogAggState AppLogAggState = APP_LOGAGG_OFF;     ///< Aggregation state
+
+#ifdef HAVE_MPI
+static char            *AppLogAggFile = NULL;                ///< File of the writer of this rank
+static int              AppLogAggWriter = FALSE;             ///< This rank writes the file
+static int              AppLogAggHead = FALSE;               ///< This rank is a node head
+static MPI_Comm         AppLogAggNode = MPI_COMM_NULL;       ///< Node communicator (rank 0 is the node head)
+static MPI_Comm         AppLogAggHeads = MPI_COMM_NULL;      ///< Node heads of a writer group (rank 0 is the writer)
+static pthread_t        AppLogAggThread;                     ///< Thread allowed to make the MPI calls
+static FILE            *AppLogAggStream = NULL;              ///< Memory stream of non writer ranks
+static char            *AppLogAggBuf[2] = { NULL, NULL };    ///< Double buffer (filling, in flight)
+static size_t           AppLogAggBufSize[2] = { 0, 0 };
+static size_t           AppLogAggLen = 0;                    ///< Length of the filling buffer
+static int              AppLogAggCur = 0;                    ///< Index of the filling buffer
+static MPI_Request      AppLogAggReq = MPI_REQUEST_NULL;     ///< Request of the buffer in flight
+static char            *AppLogAggRecv = NULL;                ///< Receive buffer
+static int              AppLogAggRecvSize = 0;
+static int64_t          AppLogAggLast = 0;                   ///< Time of the last shipping (ms)
+static unsigned long    AppLogAggDropped = 0;                ///< Number of lines dropped since the last one kept
+static int              AppLogAggPartial = FALSE;            ///< Dropping the rest of a line
+static pthread_t        AppLogAggProgress;                   ///< Progress thread of node heads
+static volatile int     AppLogAggPolling = FALSE;            ///< Progress thread is running
+static volatile int     AppLogAggForce = FALSE;              ///< Progress thread has to ship whatever the buffer size or delay
+
+//! Get a coarse monotonic time in milliseconds
+static inline int64_t App_LogAggNow(void) {
+   struct timespec ts;
+#ifdef CLOCK_MONOTONIC_COARSE
+   clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+   return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+//! Append to the filling buffer
+static int App_LogAggAppend(const char *Buf, size_t Len) {
+   //! \return FALSE if out of memory
+
+   if (AppLogAggLen + Len > AppLogAggBufSize[AppLogAggCur]) {
+      size_t size = MAX(AppLogAggLen + Len, 2 * AppLogAggBufSize[AppLogAggCur]);
+      char  *buf = (char*)realloc(AppLogAggBuf[AppLogAggCur], size);
+      if (!buf) return FALSE;
+      AppLogAggBuf[AppLogAggCur] = buf;
+      AppLogAggBufSize[AppLogAggCur] = size;
+   }
+   memcpy(AppLogAggBuf[AppLogAggCur] + AppLogAggLen, Buf, Len);
+   AppLogAggLen += Len;
+   return TRUE;
+}
+
+//! Let the reader know about the lines dropped, the filling buffer ending with a whole line
+static void App_LogAggDropNote(void) {
+   char msg[128];
+
+   if (AppLogAggDropped) {
+      App_LogAggAppend(msg, snprintf(msg, sizeof(msg), "(WARNING) %lu log lines dropped, the log aggregation buffer was full\n", AppLogAggDropped));
+      AppLogAggDropped = 0;
+   }
+}
+
+//! Memory stream write callback, records are kept until shipped
+static ssize_t App_LogAggWrite(void *Cookie, const char *Buf, size_t Len) {
+
+   (void)Cookie;
+
+   // Aggregation is over, the writer's file is not ours to append to (the writer might be rotating or mapping it)
+   if (AppLogAggState == APP_LOGAGG_DONE) {
+      fwrite(Buf, 1, Len, stderr);
+      return Len;
+   }
+
+   const char *buf = Buf;
+   size_t      len = Len;
+
+   // Skip the end of a line partly dropped
+   if (AppLogAggPartial) {
+      const char *nl = memchr(buf, '\n', len);
+      if (!nl) return Len;
+      len -= nl + 1 - buf;
+      buf = nl + 1;
+      AppLogAggPartial = FALSE;
+   }
+   if (!len) return Len;
+
+   // The buffer is full, the previous batch still being in flight, drop whole lines
+   if (AppLogAggLen && AppLogAggLen + len > 2 * (size_t)AppLogAggSize) {
+      char *nl = memrchr(AppLogAggBuf[AppLogAggCur], '\n', AppLogAggLen);
+      size_t kept = nl ? nl + 1 - AppLogAggBuf[AppLogAggCur] : 0;
+
+      if (kept < AppLogAggLen) {
+         AppLogAggDropped++;
+         AppLogAggLen = kept;
+      }
+      for(const char *c = buf; (c = memchr(c, '\n', buf + len - c)); c++) AppLogAggDropped++;
+      AppLogAggPartial = buf[len - 1] != '\n';
+      if (AppLogAggPartial) AppLogAggDropped++;
+      return Len;
+   }
+
+   App_LogAggDropNote();
+   return App_LogAggAppend(buf, len) ? (ssize_t)Len : 0;
+}
+
+//! Receive the pending batches of a communicator and write them to our log stream
+static int App_LogAggReceive(
+    //! [in] Communicator to receive from
+    MPI_Comm Comm,
+    //! [in] Wait for the batches of this many ranks to end (0: only receive what is there)
+    int Ends
+) {
+   //! \return Number of batches received
+   MPI_Status st;
+   int        flag = TRUE, len, nb = 0;
+
+   // Forwarding ranks might not have logged anything yet
+   if (!App->LogStream) App_LogOpen();
+
+   while (Ends || flag) {
+      if (Ends) {
+         MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, Comm, &st);
+      } else {
+         MPI_Iprobe(MPI_ANY_SOURCE, APP_LOGAGG_TAGDATA, Comm, &flag, &st);
+         if (!flag) break;
+      }
+      MPI_Get_count(&st, MPI_BYTE, &len);
+
+      if (len > AppLogAggRecvSize) {
+         char *buf = (char*)realloc(AppLogAggRecv, len);
+         if (!buf) {
+            MPI_Abort(Comm, EXIT_FAILURE);
+         }
+         AppLogAggRecv = buf;
+         AppLogAggRecvSize = len;
+      }
+      MPI_Recv(AppLogAggRecv, len, MPI_BYTE, st.MPI_SOURCE, st.MPI_TAG, Comm, MPI_STATUS_IGNORE);
+
+      if (st.MPI_TAG == APP_LOGAGG_TAGEND) {
+         Ends--;
+      } else if (len) {
+         pthread_mutex_lock(&App_mutex);
+         fwrite(AppLogAggRecv, 1, len, App->LogStream);
+         pthread_mutex_unlock(&App_mutex);
+         nb++;
+      }
+   }
+   return nb;
+}
+
+//! Ship the filling buffer to the next rank up the aggregation tree
+static void App_LogAggShip(
+    //! [in] Ship even if the buffer is not full nor the delay elapsed
+    const int Force,
+    //! [in] Wait for the batch in flight to be received (only when every rank is ending, the receiver might not be listening)
+    const int Wait
+) {
+   int done = TRUE;
+
+   if (AppLogAggWriter) return;
+
+   // Keep filling until the batch in flight has been received
+   if (AppLogAggReq != MPI_REQUEST_NULL) {
+      if (Wait) {
+         MPI_Wait(&AppLogAggReq, MPI_STATUS_IGNORE);
+      } else {
+         MPI_Test(&AppLogAggReq, &done, MPI_STATUS_IGNORE);
+         if (!done) return;
+      }
+   }
+
+   // Records are written whole under the log lock, flushing here cannot split one
+   pthread_mutex_lock(&App_mutex);
+   fflush(AppLogAggStream);
+   App_LogAggDropNote();
+
+   int64_t now = App_LogAggNow();
+   if (!AppLogAggLen || (!Force && AppLogAggLen < (size_t)AppLogAggSize && now - AppLogAggLast < AppLogAggDelay)) {
+      pthread_mutex_unlock(&App_mutex);
+      return;
+   }
+   AppLogAggLast = now;
+   char *buf = AppLogAggBuf[AppLogAggCur];
+   int   len = AppLogAggLen;
+   AppLogAggCur ^= 1;
+   AppLogAggLen = 0;
+   pthread_mutex_unlock(&App_mutex);
+
+   MPI_Isend(buf, len, MPI_BYTE, 0, APP_LOGAGG_TAGDATA, AppLogAggHead ? AppLogAggHeads : AppLogAggNode, &AppLogAggReq);
+}
+
+//! Progress thread of node heads, receive and forward the batches whether the head logs or not
+static void* App_LogAggPoll(void *Arg) {
+   const struct timespec poll = { 0, APP_LOGAGG_POLL * 1000000 };
+
+   (void)Arg;
+   while (AppLogAggPolling) {
+      App_LogAggReceive(AppLogAggNode, 0);
+      if (AppLogAggWriter) App_LogAggReceive(AppLogAggHeads, 0);
+      App_LogAggShip(AppLogAggForce, FALSE);
+      AppLogAggForce = FALSE;
+      nanosleep(&poll, NULL);
+   }
+   return NULL;
+}
+
+//! Stop the progress thread of node heads
+static void App_LogAggPollStop(void) {
+
+   if (AppLogAggPolling) {
+      AppLogAggPolling = FALSE;
+      pthread_join(AppLogAggProgress, NULL);
+   }
+}
+#endif //HAVE_MPI
+
+//! Configure the collective log aggregation
+int App_LogAggregate(
+    //! [in] Number of writer ranks (0: every rank writes to the log file)
+    const int Writers,
+    //! [in] Buffer size in bytes before records are shipped (0: default)
+    const int Size,
+    //! [in] Delay in milliseconds after which records are shipped, checked when the rank logs and at \ref App_LogStep (0: default)
+    const int Delay
+) {
+   //! \return Previous number of writer ranks
+   //! \note Must be called before \ref App_Start, aggregation is set up collectively there
+   int pw = App->LogAggregate;
+
+   App->LogAggregate = Writers > 0 ? Writers : 0;
+   AppLogAggSize = Size > 0 ? Size : APP_LOGAGG_SIZE;
+   AppLogAggDelay = Delay > 0 ? Delay : APP_LOGAGG_DELAY;
+
+   return pw;
+}
+
+//! Set up the aggregation tree (collective on App->Comm)
+int App_LogAggregateInit(void) {
+   //! \return APP_OK if aggregating, APP_ERR otherwise
+
+#ifdef HAVE_MPI
+   int open, nb = 0, rank, writer;
+
+   if (AppLogAggState != APP_LOGAGG_OFF || !App->LogAggregate || !App_IsMPI() || App->LogSplit || !App->LogFile
+      || strcmp(App->LogFile, "stdout") == 0 || strcmp(App->LogFile, "stderr") == 0) {
+      return APP_ERR;
+   }
+
+   // Ranks that already opened their stream keep writing to it directly
+   open = App->LogStream != NULL;
+   MPI_Allreduce(MPI_IN_PLACE, &open, 1, MPI_INT, MPI_MAX, App->Comm);
+   if (open) {
+      if (!App->RankMPI) {
+         fprintf(stderr, "(WARNING) Log stream already opened, log aggregation disabled\n");
+      }
+      return APP_ERR;
+   }
+
+   if (App->NodeComm == MPI_COMM_NULL) {
+      App_NodeGroup();
+   }
+   MPI_Comm_dup(App->NodeComm, &AppLogAggNode);
+   MPI_Comm_rank(AppLogAggNode, &rank);
+   AppLogAggHead = !rank;
+
+   // Split the node heads in groups, the first head of each group is its writer
+   MPI_Comm heads;
+   MPI_Comm_split(App->Comm, AppLogAggHead ? 0 : MPI_UNDEFINED, App->RankMPI, &heads);
+   if (AppLogAggHead) {
+      MPI_Comm_size(heads, &nb);
+      MPI_Comm_rank(heads, &rank);
+      MPI_Comm_split(heads, (int)((int64_t)rank * MIN(App->LogAggregate, nb) / nb), rank, &AppLogAggHeads);
+      MPI_Comm_free(&heads);
+      MPI_Comm_rank(AppLogAggHeads, &rank);
+      AppLogAggWriter = !rank;
+   }
+
+   // Let everyone know its writer's rank to name the file
+   writer = App->RankMPI;
+   if (AppLogAggHead) MPI_Bcast(&writer, 1, MPI_INT, 0, AppLogAggHeads);
+   MPI_Bcast(&writer, 1, MPI_INT, 0, AppLogAggNode);
+   MPI_Allreduce(MPI_IN_PLACE, &nb, 1, MPI_INT, MPI_MAX, App->Comm);
+
+   if (MIN(App->LogAggregate, nb) > 1) {
+      size_t len = strlen(App->LogFile) + 16;
+      AppLogAggFile = (char*)malloc(len);
+      snprintf(AppLogAggFile, len, "%s.%06d", App->LogFile, writer);
+   } else {
+      AppLogAggFile = strdup(App->LogFile);
+   }
+
+   if (!AppLogAggWriter) {
+      cookie_io_functions_t io = { NULL, App_LogAggWrite, NULL, NULL };
+      // Records are buffered by the callback, keep them whole there
+      if ((AppLogAggStream = fopencookie(NULL, "w", io))) setvbuf(AppLogAggStream, NULL, _IONBF, 0);
+   }
+   AppLogAggThread = pthread_self();
+   AppLogAggLast = App_LogAggNow();
+   AppLogAggState = APP_LOGAGG_ON;
+
+   // Node heads receive in the background if MPI allows it
+   int level;
+   MPI_Query_thread(&level);
+   if (AppLogAggHead && level == MPI_THREAD_MULTIPLE) {
+      AppLogAggPolling = TRUE;
+      if (pthread_create(&AppLogAggProgress, NULL, App_LogAggPoll, NULL)) {
+         AppLogAggPolling = FALSE;
+      }
+   }
+
+   return APP_OK;
+#else
+   return APP_ERR;
+#endif //HAVE_MPI
+}
+
+//! Open the log stream of this rank when aggregating
+FILE* App_LogAggregateOpen(
+    //! [out] This rank is the only one writing to the file
+    int *Owner
+) {
+   //! \return Log stream, NULL if not aggregating
+   *Owner = FALSE;
+   if (AppLogAggState != APP_LOGAGG_ON) return NULL;
+
+#ifdef HAVE_MPI
+   if (AppLogAggWriter) {
+      *Owner = TRUE;
+      return App_LogFileOpen(AppLogAggFile, "w");
+   }
+   return AppLogAggStream;
+#else
+   return NULL;
+#endif
+}
+
+//! Ship the records of this rank and forward the records received, if the buffer is full or the delay elapsed
+void App_LogAggregateFlush(
+    //! [in] Ship whatever the buffer size or delay
+    const int Force
+) {
+#ifdef HAVE_MPI
+   if (AppLogAggState != APP_LOGAGG_ON || !pthread_equal(pthread_self(), AppLogAggThread) || !App->LogStream) return;
+
+   // The progress thread does it
+   if (AppLogAggPolling) {
+      if (Force) AppLogAggForce = TRUE;
+      return;
+   }
+
+   if (AppLogAggHead) {
+      App_LogAggReceive(AppLogAggNode, 0);
+      if (AppLogAggWriter) App_LogAggReceive(AppLogAggHeads, 0);
+   }
+   App_LogAggShip(Force, FALSE);
+#else
+   (void)Force;
+#endif
+}
+
+//! Stop aggregating and make sure every record made it to a file
+void App_LogAggregateEnd(
+    //! [in] Called by every rank of App->Comm, records are collected by the writers
+    const int Collective
+) {
+#ifdef HAVE_MPI
+   int nb;
+
+   if (AppLogAggState != APP_LOGAGG_ON) return;
+
+   App_LogAsyncFlush();
+   App_LogAggPollStop();
+   if (Collective && pthread_equal(pthread_self(), AppLogAggThread)) {
+      // Our node's records (and the node heads' if writer) first, then ours, then the end mark
+      if (AppLogAggHead) {
+         MPI_Comm_size(AppLogAggNode, &nb);
+         App_LogAggReceive(AppLogAggNode, nb - 1);
+      }
+      if (AppLogAggWriter) {
+         MPI_Comm_size(AppLogAggHeads, &nb);
+         App_LogAggReceive(AppLogAggHeads, nb - 1);
+         pthread_mutex_lock(&App_mutex);
+         fflush(App->LogStream);
+         pthread_mutex_unlock(&App_mutex);
+      } else {
+         if (App->LogStream) App_LogAggShip(TRUE, TRUE);
+         MPI_Wait(&AppLogAggReq, MPI_STATUS_IGNORE);
+         MPI_Send(NULL, 0, MPI_BYTE, 0, APP_LOGAGG_TAGEND, AppLogAggHead ? AppLogAggHeads : AppLogAggNode);
+      }
+      MPI_Comm_free(&AppLogAggNode);
+      if (AppLogAggHead) MPI_Comm_free(&AppLogAggHeads);
+      AppLogAggState = APP_LOGAGG_DONE;
+   } else {
+      // Nobody is listening anymore, write what is left to stderr
+      pthread_mutex_lock(&App_mutex);
+      if (AppLogAggStream) fflush(AppLogAggStream);
+      App_LogAggDropNote();
+      AppLogAggState = APP_LOGAGG_DONE;
+      if (AppLogAggLen) {
+         App_LogAggWrite(NULL, AppLogAggBuf[AppLogAggCur], AppLogAggLen);
+         AppLogAggLen = 0;
+      }
+      pthread_mutex_unlock(&App_mutex);
+   }
+#else
+   (void)Collective;
+#endif
+}
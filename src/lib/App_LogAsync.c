@@ -0,0 +1,351 @@
+//! \file
+//! Asynchronous log writer
+//!
+//! When enabled (APP_LOG_ASYNC), formatted log records are not written by the calling thread.
+//! Each thread pushes its records into its own single producer/single consumer ring buffer and a
+//! dedicated writer thread drains all rings into a large batch buffer that is written in one call.
+//! Memory is bounded by the ring size times the number of threads (at most APP_LOGASYNC_MAXRING).
+//! When a ring is full, the producer either waits for the writer (APP_LOGASYNC_BLOCK) or the record
+//! is dropped and counted (APP_LOGASYNC_DROP).
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "App.h"
+#include "App_Log.h"
+#include "str.h"
+
+#define APP_LOGASYNC_MAXRING  256               ///< Maximum number of per thread rings (threads)
+#define APP_LOGASYNC_BATCH    (1<<20)           ///< Writer batch buffer size
+#define APP_LOGASYNC_WAIT_MS  10                ///< Writer idle wait
+
+#define APP_ALIGN8(N) (((N)+7)&~((uint64_t)7))
+
+//! Per thread ring buffer
+typedef struct {
+   char             *Buf;                       ///< Ring storage
+   uint64_t          Size;                      ///< Ring size (power of 2)
+   volatile uint64_t Head;                      ///< Write position (updated by the producer only)
+   volatile uint64_t Tail;                      ///< Read position (updated by the writer only)
+   volatile uint64_t Written;                   ///< Position up to which records are written and flushed (updated by the writer only)
+} TApp_LogRing;
+
+static TApp_LogRing    *AppLogRings[APP_LOGASYNC_MAXRING];   ///< Registered rings
+static volatile int32_t AppLogRingNb = 0;                    ///< Number of registered rings
+static volatile int     AppLogRingGen = 0;                   ///< Generation of the rings, changed when they are freed
+static volatile int     AppLogPushers = 0;                   ///< Number of producers pushing
+static __thread TApp_LogRing *AppLogRing = NULL;             ///< Ring of the current thread
+static __thread int     AppLogRingThreadGen = 0;             ///< Generation of the ring of the current thread
+
+static pthread_t        AppLogWriter;                        ///< Writer thread
+static pthread_mutex_t  AppLogWriterMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   AppLogWriterCond = PTHREAD_COND_INITIALIZER;
+static volatile int     AppLogWriterRun = FALSE;             ///< Writer thread is running
+static FILE            *AppLogWriterStream = NULL;           ///< Stream the writer drains to
+static char            *AppLogBatch = NULL;                  ///< Writer batch buffer
+static volatile int64_t AppLogDropped = 0;                   ///< Number of dropped records
+
+//! Allocate and register a ring for the current thread
+static TApp_LogRing* App_LogRingNew(void) {
+
+   uint64_t size = 4096;
+   while (size < (uint64_t)App->LogAsync) size <<= 1;
+
+   int32_t n = __sync_fetch_and_add(&AppLogRingNb, 1);
+   if (n >= APP_LOGASYNC_MAXRING) {
+      __sync_fetch_and_sub(&AppLogRingNb, 1);
+      return NULL;
+   }
+
+   TApp_LogRing *ring = (TApp_LogRing*)calloc(1, sizeof(TApp_LogRing));
+   if (ring && !(ring->Buf = (char*)malloc(size))) {
+      free(ring);
+      ring = NULL;
+   }
+   if (ring) ring->Size = size;
+
+   // Publish even if NULL so the writer does not wait on an empty slot
+   __atomic_store_n(&AppLogRings[n], ring, __ATOMIC_RELEASE);
+   return ring;
+}
+
+//! Copy bytes into the ring, wrapping around at the end
+static inline void App_LogRingCopyIn(TApp_LogRing *Ring, uint64_t Pos, const char *Src, uint64_t Len) {
+   uint64_t off = Pos & (Ring->Size - 1);
+   uint64_t n = MIN(Len, Ring->Size - off);
+   memcpy(Ring->Buf + off, Src, n);
+   if (n < Len) memcpy(Ring->Buf, Src + n, Len - n);
+}
+
+//! Copy bytes out of the ring, wrapping around at the end
+static inline void App_LogRingCopyOut(TApp_LogRing *Ring, uint64_t Pos, char *Dst, uint64_t Len) {
+   uint64_t off = Pos & (Ring->Size - 1);
+   uint64_t n = MIN(Len, Ring->Size - off);
+   memcpy(Dst, Ring->Buf + off, n);
+   if (n < Len) memcpy(Dst + n, Ring->Buf, Len - n);
+}
+
+//! Wake up the writer thread
+static inline void App_LogAsyncWake(void) {
+   pthread_cond_signal(&AppLogWriterCond);
+}
+
+//! Write a buffer to the log stream
+static void App_LogAsyncWrite(const char *Buf, size_t Len) {
+   pthread_mutex_lock(&App_mutex);
+   fwrite(Buf, 1, Len, AppLogWriterStream);
+   pthread_mutex_unlock(&App_mutex);
+}
+
+//! Drain every ring into the batch buffer and write it out
+static uint64_t App_LogAsyncDrainRings(void) {
+
+   uint64_t total = 0, len, size = 0;
+   uint64_t tails[APP_LOGASYNC_MAXRING];
+   TApp_LogRing *rings[APP_LOGASYNC_MAXRING];
+   int32_t  nb = MIN(__atomic_load_n(&AppLogRingNb, __ATOMIC_ACQUIRE), APP_LOGASYNC_MAXRING);
+
+   for(int32_t r = 0; r < nb; r++) {
+      TApp_LogRing *ring = rings[r] = __atomic_load_n(&AppLogRings[r], __ATOMIC_ACQUIRE);
+      if (!ring) continue;
+
+      uint64_t tail = ring->Tail;
+      uint64_t head = __atomic_load_n(&ring->Head, __ATOMIC_ACQUIRE);
+      while (tail < head) {
+         // Record header is 8 byte aligned and never wraps
+         len = *(uint64_t*)(ring->Buf + (tail & (ring->Size - 1)));
+
+         if (size + len > APP_LOGASYNC_BATCH) {
+            App_LogAsyncWrite(AppLogBatch, size);
+            total += size;
+            size = 0;
+         }
+         App_LogRingCopyOut(ring, tail + 8, AppLogBatch + size, len);
+         size += len;
+         tail += 8 + APP_ALIGN8(len);
+
+         // Release space as we go so blocked producers can proceed
+         __atomic_store_n(&ring->Tail, tail, __ATOMIC_RELEASE);
+      }
+      tails[r] = tail;
+   }
+   if (size) {
+      App_LogAsyncWrite(AppLogBatch, size);
+      total += size;
+   }
+   if (total) {
+      pthread_mutex_lock(&App_mutex);
+      fflush(AppLogWriterStream);
+      pthread_mutex_unlock(&App_mutex);
+
+      // Only now are the records out, let App_LogAsyncFlush return
+      for(int32_t r = 0; r < nb; r++) {
+         if (rings[r]) __atomic_store_n(&rings[r]->Written, tails[r], __ATOMIC_RELEASE);
+      }
+   }
+   return total;
+}
+
+//! Writer thread main loop
+static void* App_LogAsyncThread(void *Arg) {
+
+   struct timespec ts;
+
+   (void)Arg;
+   while (__atomic_load_n(&AppLogWriterRun, __ATOMIC_ACQUIRE)) {
+      if (!App_LogAsyncDrainRings()) {
+         clock_gettime(CLOCK_REALTIME, &ts);
+         ts.tv_nsec += APP_LOGASYNC_WAIT_MS * 1000000;
+         if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+         }
+         pthread_mutex_lock(&AppLogWriterMutex);
+         pthread_cond_timedwait(&AppLogWriterCond, &AppLogWriterMutex, &ts);
+         pthread_mutex_unlock(&AppLogWriterMutex);
+      }
+   }
+   return NULL;
+}
+
+//! Configure the asynchronous log writer
+int App_LogAsync(
+    //! [in] Ring size per thread in bytes (0: synchronous logging)
+    const int Size,
+    //! [in] Policy when a ring is full (APP_LOGASYNC_BLOCK, APP_LOGASYNC_DROP)
+    const TApp_LogAsyncPolicy Policy
+) {
+   //! \return Previous ring size
+   //! \note Must be called before the log stream is opened (first message or \ref App_LogOpen)
+   int ps = App->LogAsync;
+
+   App->LogAsync = Size > 0 ? Size : 0;
+   App->LogAsyncPolicy = Policy;
+
+   return ps;
+}
+
+//! Start the writer thread on the given stream
+int App_LogAsyncStart(
+    //! [in] Stream the records will be written to
+    FILE *Stream
+) {
+   //! \return APP_OK if the writer is running, APP_ERR otherwise
+
+   if (AppLogWriterRun) return APP_OK;
+
+   if (!AppLogBatch && !(AppLogBatch = (char*)malloc(APP_LOGASYNC_BATCH))) {
+      return APP_ERR;
+   }
+
+   AppLogWriterStream = Stream;
+   __atomic_store_n(&AppLogWriterRun, TRUE, __ATOMIC_RELEASE);
+   if (pthread_create(&AppLogWriter, NULL, App_LogAsyncThread, NULL)) {
+      __atomic_store_n(&AppLogWriterRun, FALSE, __ATOMIC_RELEASE);
+      return APP_ERR;
+   }
+
+   // Make sure we drain on any exit path
+   static int registered = FALSE;
+   if (!registered) {
+      atexit(App_LogAsyncStop);
+      registered = TRUE;
+   }
+   return APP_OK;
+}
+
+//! Push a formatted record into the ring of the current thread
+static int App_LogAsyncPushRing(
+    //! [in] Formatted record
+    const char *Rec,
+    //! [in] Record length
+    size_t Len
+) {
+   //! \return APP_OK if the record was queued (or dropped by policy), APP_ERR if the caller has to write it itself
+
+   // Rings freed by App_LogAsyncStop since this thread got one
+   if (AppLogRingThreadGen != AppLogRingGen) {
+      AppLogRing = NULL;
+      AppLogRingThreadGen = AppLogRingGen;
+   }
+
+   TApp_LogRing *ring = AppLogRing;
+   if (!ring && !(ring = AppLogRing = App_LogRingNew())) {
+      return APP_ERR;
+   }
+
+   uint64_t need = 8 + APP_ALIGN8(Len);
+   if (need > ring->Size / 2 || Len > APP_LOGASYNC_BATCH) {
+      // Too large for the ring, keep ordering by draining our ring first
+      App_LogAsyncFlush();
+      return APP_ERR;
+   }
+
+   uint64_t head = ring->Head;
+   while (head + need - __atomic_load_n(&ring->Tail, __ATOMIC_ACQUIRE) > ring->Size) {
+      if (App->LogAsyncPolicy == APP_LOGASYNC_DROP) {
+         __sync_fetch_and_add(&AppLogDropped, 1);
+         return APP_OK;
+      }
+      // Writer stopping, nobody will make room anymore
+      if (!__atomic_load_n(&AppLogWriterRun, __ATOMIC_ACQUIRE)) return APP_ERR;
+      App_LogAsyncWake();
+      sched_yield();
+   }
+
+   *(uint64_t*)(ring->Buf + (head & (ring->Size - 1))) = Len;
+   App_LogRingCopyIn(ring, head + 8, Rec, Len);
+   __atomic_store_n(&ring->Head, head + need, __ATOMIC_RELEASE);
+
+   // Do not let the ring fill up before waking up the writer
+   if (head + need - ring->Tail > ring->Size / 2) {
+      App_LogAsyncWake();
+   }
+   return APP_OK;
+}
+
+//! Push a formatted record for the writer thread
+int App_LogAsyncPush(
+    //! [in] Formatted record
+    const char *Rec,
+    //! [in] Record length
+    size_t Len
+) {
+   //! \return APP_OK if the record was queued (or dropped by policy), APP_ERR if the caller has to write it itself
+   int ok = APP_ERR;
+
+   // Register before checking, so that stopping waits for us before freeing the rings
+   __atomic_add_fetch(&AppLogPushers, 1, __ATOMIC_SEQ_CST);
+   if (__atomic_load_n(&AppLogWriterRun, __ATOMIC_SEQ_CST) && App->LogStream == AppLogWriterStream) {
+      ok = App_LogAsyncPushRing(Rec, Len);
+   }
+   __atomic_sub_fetch(&AppLogPushers, 1, __ATOMIC_RELEASE);
+
+   return ok;
+}
+
+//! Wait until every record queued so far has been written
+void App_LogAsyncFlush(void) {
+
+   uint64_t heads[APP_LOGASYNC_MAXRING];
+   struct timespec ts = { 0, 100000 };
+
+   if (!__atomic_load_n(&AppLogWriterRun, __ATOMIC_ACQUIRE)) return;
+
+   int32_t nb = MIN(__atomic_load_n(&AppLogRingNb, __ATOMIC_ACQUIRE), APP_LOGASYNC_MAXRING);
+   for(int32_t r = 0; r < nb; r++) {
+      TApp_LogRing *ring = __atomic_load_n(&AppLogRings[r], __ATOMIC_ACQUIRE);
+      heads[r] = ring ? __atomic_load_n(&ring->Head, __ATOMIC_ACQUIRE) : 0;
+   }
+
+   App_LogAsyncWake();
+   for(int32_t r = 0; r < nb; r++) {
+      TApp_LogRing *ring = __atomic_load_n(&AppLogRings[r], __ATOMIC_ACQUIRE);
+      while (ring && __atomic_load_n(&ring->Written, __ATOMIC_ACQUIRE) < heads[r] && AppLogWriterRun) {
+         nanosleep(&ts, NULL);
+      }
+   }
+}
+
+//! Stop the writer thread, write out everything that is left and free the rings
+void App_LogAsyncStop(void) {
+
+   if (!__atomic_load_n(&AppLogWriterRun, __ATOMIC_ACQUIRE)) return;
+
+   __atomic_store_n(&AppLogWriterRun, FALSE, __ATOMIC_SEQ_CST);
+   App_LogAsyncWake();
+   pthread_join(AppLogWriter, NULL);
+
+   // Let the producers that got in finish their push
+   while (__atomic_load_n(&AppLogPushers, __ATOMIC_ACQUIRE)) {
+      sched_yield();
+   }
+
+   // Writer is gone, we are now the only consumer
+   App_LogAsyncDrainRings();
+
+   // Threads get a new ring if the writer is started again
+   int32_t nb = MIN(__atomic_load_n(&AppLogRingNb, __ATOMIC_ACQUIRE), APP_LOGASYNC_MAXRING);
+   for(int32_t r = 0; r < nb; r++) {
+      if (AppLogRings[r]) {
+         free(AppLogRings[r]->Buf);
+         free(AppLogRings[r]);
+         AppLogRings[r] = NULL;
+      }
+   }
+   __atomic_store_n(&AppLogRingNb, 0, __ATOMIC_RELEASE);
+   __atomic_add_fetch(&AppLogRingGen, 1, __ATOMIC_RELEASE);
+   APP_FREE(AppLogBatch);
+
+   if (AppLogDropped) {
+      pthread_mutex_lock(&App_mutex);
+      fprintf(AppLogWriterStream, "(WARNING) %li log messages dropped by the asynchronous writer\n", (long)AppLogDropped);
+      fflush(AppLogWriterStream);
+      pthread_mutex_unlock(&App_mutex);
+      AppLogDropped = 0;
+   }
+}
@@ -0,0 +1,636 @@
+//! \file
+//! Binary log format with deferred formatting
+//!
+//! In binary mode (APP_LOG_FORMAT=BINARY), \ref Lib_Log does not format the messages. Each record only holds
+//! a format string id, a timestamp, the rank, thread, step, library and level and the raw bytes of the
+//! arguments. The format strings are written once per process in definition records. The file is turned
+//! back into the text format by \ref App_LogDecode (app decode -i [file]).
+//!
+//! Stream layout:
+//! - File header (\ref TApp_LogBinHeader), written when the file is created
+//! - Format definition records (\ref TApp_LogBinDef) followed by the format string
+//! - Library definition records (\ref TApp_LogBinDef, the id of the library in Fmt) followed by the library name,
+//!   for the libraries registered at run time (\ref App_LibRegisterDynamic), written before their first message
+//! - Message records (\ref TApp_LogBinMsg) followed by the encoded arguments
+//!
+//! Format and run time library ids are per process (rank) and a message can precede its definitions when multiple
+//! threads log concurrently, the decoder therefore reads the definitions first.
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "App.h"
+#include "App_Log.h"
+#include "str.h"
+
+#define APP_LOGBIN_MAGIC   "APPBLOG"           ///< File magic (+ version byte)
+#define APP_LOGBIN_VERSION 1                   ///< File format version
+#define APP_LOGBIN_MAXFMT  8192                ///< Maximum number of format strings per process (power of 2)
+#define APP_LOGBIN_DEF     1                   ///< Format definition record
+#define APP_LOGBIN_MSG     2                   ///< Message record
+#define APP_LOGBIN_LIB     3                   ///< Library definition record
+#define APP_LOGBIN_THREAD  0x01                ///< Message record flag: show thread id
+#define APP_LOGBIN_RAW     0                   ///< Format id of preformatted messages (single string argument)
+
+//! File header
+typedef struct {
+   char     Magic[8];                          ///< APP_LOGBIN_MAGIC + version
+   int32_t  LogTime;                           ///< Time display mode (TApp_LogTime)
+   int32_t  UTC;                               ///< Use UTC time
+   int64_t  Start;                             ///< Application start time (us since epoch)
+   char     Name[48];                          ///< Application name
+} TApp_LogBinHeader;
+
+//! Format (or library) definition record
+typedef struct {
+   uint8_t  Type;                              ///< APP_LOGBIN_DEF (APP_LOGBIN_LIB)
+   uint8_t  Pad[3];
+   uint32_t Fmt;                               ///< Format id (library id)
+   int32_t  Rank;                              ///< Rank that defined the format (library)
+   uint32_t Len;                               ///< Length of the format string (library name) that follows
+} TApp_LogBinDef;
+
+//! Message record
+typedef struct {
+   uint8_t  Type;                              ///< APP_LOGBIN_MSG
+   int8_t   Level;                             ///< Log level
+   uint8_t  Lib;                               ///< Library
+   uint8_t  Flags;                             ///< APP_LOGBIN_THREAD
+   uint32_t Fmt;                               ///< Format id
+   int64_t  Time;                              ///< Timestamp (us since epoch)
+   int32_t  Rank;                              ///< MPI rank
+   int32_t  Thread;                            ///< Thread id
+   int32_t  Step;                              ///< Model step
+   uint32_t Len;                               ///< Length of the encoded arguments that follow
+} TApp_LogBinMsg;
+
+//! Format string table entry
+typedef struct {
+   const char        *Ptr;                     ///< Format string address (key)
+   char              *Format;                  ///< Format string content when registered (format strings can be buffers)
+   volatile uint32_t  Id;                      ///< Format id (0 until published)
+   char              *Types;                   ///< Argument types
+} TApp_LogBinFmt;
+
+static TApp_LogBinFmt   AppLogBinFmts[APP_LOGBIN_MAXFMT];   ///< Format string table
+static volatile int32_t AppLogBinFmtNb = 0;                 ///< Last format id
+static volatile uint64_t AppLogBinLibs = 0;                 ///< Run time libraries already defined (one bit per id, APP_LIBSMAX is 64)
+static __thread char   *AppLogBinBuf = NULL;                ///< Per thread record buffer
+static __thread size_t  AppLogBinBufSize = 0;               ///< Per thread record buffer size
+
+//! Parse a printf conversion specification
+static const char* App_LogBinarySpec(
+    //! [in] Format string pointing to the character following '%'
+    const char *Fmt,
+    //! [out] Argument type ('i':int, 'l':64 bit int, 'd':double, 'L':long double, 's':string, 'S':string bounded by a '*' precision,
+    //! 'p':pointer, 'n':ignored pointer, 0:no argument)
+    char *Type,
+    //! [out] Number of '*' width/precision arguments
+    int *Stars
+) {
+   //! \return Pointer to the character following the conversion
+   int len = 0, prec = FALSE;
+
+   *Stars = 0;
+   while (*Fmt && strchr("-+ #0'I", *Fmt)) Fmt++;
+   if (*Fmt == '*') { (*Stars)++; Fmt++; }
+   while (*Fmt >= '0' && *Fmt <= '9') Fmt++;
+   if (*Fmt == '.') {
+      Fmt++;
+      if (*Fmt == '*') { (*Stars)++; prec = TRUE; Fmt++; }
+      while (*Fmt >= '0' && *Fmt <= '9') Fmt++;
+   }
+   while (*Fmt && strchr("hlLqjzZt", *Fmt)) {
+      len = (*Fmt == 'h') ? len : (*Fmt == 'L' ? 'L' : 'l');
+      Fmt++;
+   }
+   switch (*Fmt) {
+      case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+         *Type = len == 'l' ? 'l' : 'i'; break;
+      case 'c':
+         *Type = 'i'; break;
+      case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+         *Type = len == 'L' ? 'L' : 'd'; break;
+      case 's': *Type = prec ? 'S' : 's'; break;
+      case 'p': *Type = 'p'; break;
+      case 'n': *Type = 'n'; break;
+      default:  *Type = 0;
+   }
+   return *Fmt ? Fmt + 1 : Fmt;
+}
+
+//! Get the argument types of a format string
+static char* App_LogBinaryTypes(const char *Format) {
+
+   char *types = (char*)malloc(strlen(Format) + 1);
+   char *t = types, type;
+   int   stars;
+
+   if (!types) return NULL;
+
+   while (*Format) {
+      if (*Format++ != '%') continue;
+      if (*Format == '%') { Format++; continue; }
+
+      Format = App_LogBinarySpec(Format, &type, &stars);
+      while (stars--) *t++ = 'i';
+      if (type) *t++ = type;
+   }
+   *t = '\0';
+   return types;
+}
+
+//! Make sure the per thread record buffer can hold Size bytes
+static inline int App_LogBinaryReserve(size_t Size) {
+   if (Size > AppLogBinBufSize) {
+      char *buf = (char*)realloc(AppLogBinBuf, Size + 1024);
+      if (!buf) return FALSE;
+      AppLogBinBuf = buf;
+      AppLogBinBufSize = Size + 1024;
+   }
+   return TRUE;
+}
+
+//! Find or register a format string
+static TApp_LogBinFmt* App_LogBinaryFormat(
+    //! [in] Format string
+    const char * const Format,
+    //! [out] TRUE if the format was registered by this call (definition has to be written)
+    int *New
+) {
+   //! \return Format table entry, NULL if the table is full
+   //! \note Formats are probed by address, as the call sites are, then compared with the content they were registered
+   //!       with, a buffer holding another format is a miss and gets its own entry
+
+   // Mix the address bits, the low ones are mostly alignment
+   uint64_t key = (uint64_t)(uintptr_t)Format;
+   key ^= key >> 33; key *= 0xFF51AFD7ED558CCDULL;
+   key ^= key >> 33;
+
+   uint32_t slot = key & (APP_LOGBIN_MAXFMT - 1);
+   *New = FALSE;
+
+   for(int n = 0; n < APP_LOGBIN_MAXFMT; n++, slot = (slot + 1) & (APP_LOGBIN_MAXFMT - 1)) {
+      TApp_LogBinFmt *fmt = &AppLogBinFmts[slot];
+      const char *ptr = __atomic_load_n(&fmt->Ptr, __ATOMIC_ACQUIRE);
+
+      if (!ptr) {
+         // Claim the slot
+         if (!__sync_bool_compare_and_swap(&fmt->Ptr, NULL, Format)) {
+            ptr = fmt->Ptr;
+         } else {
+            fmt->Format = strdup(Format);
+            fmt->Types = App_LogBinaryTypes(Format);
+            __atomic_store_n(&fmt->Id, (uint32_t)__sync_add_and_fetch(&AppLogBinFmtNb, 1), __ATOMIC_RELEASE);
+            *New = TRUE;
+            return fmt->Format && fmt->Types ? fmt : NULL;
+         }
+      }
+      if (ptr == Format) {
+         // Wait for the owner to publish the entry
+         while (!__atomic_load_n(&fmt->Id, __ATOMIC_ACQUIRE));
+         if (fmt->Format && strcmp(fmt->Format, Format) == 0) return fmt->Types ? fmt : NULL;
+      }
+   }
+   return NULL;
+}
+
+//! Write the binary log file header
+void App_LogBinaryHeader(
+    //! [in] Stream to write to
+    FILE *Stream
+) {
+   TApp_LogBinHeader head;
+
+   memset(&head, 0, sizeof(head));
+   memcpy(head.Magic, APP_LOGBIN_MAGIC, 7);
+   head.Magic[7] = APP_LOGBIN_VERSION;
+   head.LogTime = App->LogTime;
+   head.UTC = App->UTC;
+   head.Start = (int64_t)App->Time.tv_sec * 1000000 + App->Time.tv_usec;
+   if (App->Name) strncpy(head.Name, App->Name, sizeof(head.Name) - 1);
+
+   fwrite(&head, sizeof(head), 1, Stream);
+}
+
+//! Encode a log message into a binary record
+int App_LogBinaryRecord(
+    //! [out] Record (per thread buffer)
+    char **Rec,
+    //! [in] Library id
+    const TApp_Lib Lib,
+    //! [in] Message level
+    const TApp_LogLevel Level,
+    //! [in] Thread id
+    const int Thread,
+    //! [in] printf style format string
+    const char * const Format,
+    //! [in] Variables referrenced in the format string
+    va_list Args
+) {
+   //! \return Record length (format definition included if needed), -1 on error
+   TApp_LogBinDef  def;
+   TApp_LogBinMsg  msg;
+   TApp_LogBinFmt *fmt;
+   struct timespec now;
+   va_list         args;
+   size_t          pos = 0, len;
+   int             new;
+
+   clock_gettime(CLOCK_REALTIME, &now);
+
+   memset(&msg, 0, sizeof(msg));
+   msg.Type = APP_LOGBIN_MSG;
+   msg.Level = Level;
+   msg.Lib = Lib;
+   msg.Flags = App->LogThread ? APP_LOGBIN_THREAD : 0;
+   msg.Time = (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+   msg.Rank = App->RankMPI;
+   msg.Thread = Thread;
+   msg.Step = App->Step;
+
+   // First message of a run time library, prepend its name, its id being only known to this process
+   if (Lib > APP_LIBMETA && Lib < APP_LIBSMAX && !(__atomic_fetch_or(&AppLogBinLibs, (uint64_t)1 << Lib, __ATOMIC_RELAXED) & ((uint64_t)1 << Lib))) {
+      len = strlen(AppLibNames[Lib]);
+      if (!App_LogBinaryReserve(sizeof(def) + len)) return -1;
+      memset(&def, 0, sizeof(def));
+      def.Type = APP_LOGBIN_LIB;
+      def.Fmt = Lib;
+      def.Rank = App->RankMPI;
+      def.Len = len;
+      memcpy(AppLogBinBuf, &def, sizeof(def));
+      memcpy(AppLogBinBuf + sizeof(def), AppLibNames[Lib], len);
+      pos = sizeof(def) + len;
+   }
+
+   if (!(fmt = App_LogBinaryFormat(Format, &new))) {
+      // Format table full, store the formatted message
+      va_copy(args, Args);
+      int n = vsnprintf(NULL, 0, Format, args);
+      va_end(args);
+      if (n < 0 || !App_LogBinaryReserve(pos + sizeof(msg) + 4 + n + 1)) return -1;
+
+      va_copy(args, Args);
+      vsnprintf(AppLogBinBuf + pos + sizeof(msg) + 4, n + 1, Format, args);
+      va_end(args);
+
+      msg.Fmt = APP_LOGBIN_RAW;
+      msg.Len = 4 + n;
+      memcpy(AppLogBinBuf + pos, &msg, sizeof(msg));
+      memcpy(AppLogBinBuf + pos + sizeof(msg), &n, 4);
+      *Rec = AppLogBinBuf;
+      return pos + sizeof(msg) + msg.Len;
+   }
+
+   msg.Fmt = fmt->Id;
+
+   // New format, prepend its definition
+   if (new) {
+      len = strlen(Format);
+      if (!App_LogBinaryReserve(pos + sizeof(def) + len)) return -1;
+      memset(&def, 0, sizeof(def));
+      def.Type = APP_LOGBIN_DEF;
+      def.Fmt = fmt->Id;
+      def.Rank = App->RankMPI;
+      def.Len = len;
+      memcpy(AppLogBinBuf + pos, &def, sizeof(def));
+      memcpy(AppLogBinBuf + pos + sizeof(def), Format, len);
+      pos += sizeof(def) + len;
+   }
+
+   // Encode the arguments
+   size_t start = pos;
+   int    prec = -1;
+   pos += sizeof(msg);
+   va_copy(args, Args);
+   for(const char *t = fmt->Types; *t; t++) {
+      if (!App_LogBinaryReserve(pos + sizeof(long double))) {
+         va_end(args);
+         return -1;
+      }
+      switch (*t) {
+         case 'i': { int32_t v = va_arg(args, int);          memcpy(AppLogBinBuf + pos, &v, 4); pos += 4; prec = v; break; }
+         case 'l': { int64_t v = va_arg(args, long long);    memcpy(AppLogBinBuf + pos, &v, 8); pos += 8; break; }
+         case 'd': { double v = va_arg(args, double);        memcpy(AppLogBinBuf + pos, &v, 8); pos += 8; break; }
+         case 'L': { long double v = va_arg(args, long double); memcpy(AppLogBinBuf + pos, &v, sizeof(v)); pos += sizeof(v); break; }
+         case 'p': { uint64_t v = (uintptr_t)va_arg(args, void*); memcpy(AppLogBinBuf + pos, &v, 8); pos += 8; break; }
+         case 'n': va_arg(args, void*); break;
+         case 's':
+         case 'S': {
+            // Strings with a '*' precision may not be terminated (ie: Fortran buffers)
+            const char *s = va_arg(args, const char*);
+            uint32_t    l;
+            if (!s) s = "(null)";
+            l = (*t == 'S' && prec >= 0) ? strnlen(s, prec) : strlen(s);
+            if (!App_LogBinaryReserve(pos + 4 + l)) {
+               va_end(args);
+               return -1;
+            }
+            memcpy(AppLogBinBuf + pos, &l, 4);
+            memcpy(AppLogBinBuf + pos + 4, s, l);
+            pos += 4 + l;
+            break;
+         }
+      }
+   }
+   va_end(args);
+
+   msg.Len = pos - start - sizeof(msg);
+   memcpy(AppLogBinBuf + start, &msg, sizeof(msg));
+
+   *Rec = AppLogBinBuf;
+   return pos;
+}
+
+//! Format string (or library name) definition read by the decoder
+typedef struct {
+   int32_t  Rank;
+   uint32_t Fmt;
+   char    *Format;
+} TApp_LogBinDecodeFmt;
+
+//! Sort format (library) definitions by rank and id
+static int App_LogBinaryCmp(const void *A, const void *B) {
+   const TApp_LogBinDecodeFmt *a = (const TApp_LogBinDecodeFmt*)A, *b = (const TApp_LogBinDecodeFmt*)B;
+   if (a->Rank != b->Rank) return a->Rank < b->Rank ? -1 : 1;
+   return a->Fmt < b->Fmt ? -1 : (a->Fmt > b->Fmt);
+}
+
+//! Read the next argument bytes while decoding
+#define APP_LOGBIN_ARG(TYPE, VAR) \
+   TYPE VAR = 0; \
+   if (pos + sizeof(TYPE) <= Len) { memcpy(&VAR, Args + pos, sizeof(TYPE)); pos += sizeof(TYPE); }
+
+//! Print a message from its format string and encoded arguments
+static void App_LogBinaryPrint(FILE *Out, const char *Format, const char *Args, uint32_t Len) {
+
+   char     spec[64], type;
+   int      stars, star[2];
+   size_t   pos = 0;
+
+   while (*Format) {
+      if (*Format != '%') {
+         const char *c = strchr(Format, '%');
+         size_t      n = c ? (size_t)(c - Format) : strlen(Format);
+         fwrite(Format, 1, n, Out);
+         Format += n;
+         continue;
+      }
+      if (Format[1] == '%') {
+         fputc('%', Out);
+         Format += 2;
+         continue;
+      }
+
+      const char *end = App_LogBinarySpec(Format + 1, &type, &stars);
+      size_t      n = MIN((size_t)(end - Format), sizeof(spec) - 1);
+      memcpy(spec, Format, n);
+      spec[n] = '\0';
+      Format = end;
+
+      for(int s = 0; s < stars; s++) {
+         APP_LOGBIN_ARG(int32_t, v);
+         star[s] = v;
+      }
+
+#define APP_LOGBIN_PRINT(V) \
+      switch (stars) { \
+         case 0: fprintf(Out, spec, V); break; \
+         case 1: fprintf(Out, spec, star[0], V); break; \
+         default: fprintf(Out, spec, star[0], star[1], V); \
+      }
+
+      switch (type) {
+         case 'i': { APP_LOGBIN_ARG(int32_t, v); APP_LOGBIN_PRINT(v); break; }
+         case 'l': { APP_LOGBIN_ARG(int64_t, v); APP_LOGBIN_PRINT((long long)v); break; }
+         case 'd': { APP_LOGBIN_ARG(double, v); APP_LOGBIN_PRINT(v); break; }
+         case 'L': { APP_LOGBIN_ARG(long double, v); APP_LOGBIN_PRINT(v); break; }
+         case 'p': { APP_LOGBIN_ARG(uint64_t, v); APP_LOGBIN_PRINT((void*)(uintptr_t)v); break; }
+         case 's':
+         case 'S': {
+            APP_LOGBIN_ARG(uint32_t, l);
+            l = MIN(l, Len - pos);
+            char *s = (char*)malloc(l + 1);
+            if (s) {
+               memcpy(s, Args + pos, l);
+               s[l] = '\0';
+               APP_LOGBIN_PRINT(s);
+               free(s);
+            }
+            pos += l;
+            break;
+         }
+         case 'n': break;
+         default: fputs(spec, Out);
+      }
+#undef APP_LOGBIN_PRINT
+   }
+}
+
+//! Decode a binary log file into the text log format
+int App_LogDecode(
+    //! [in] Binary log file
+    const char * const File,
+    //! [in] Output stream
+    FILE *Out,
+    //! [in] Only decode messages from this rank (-1: all)
+    const int Rank,
+    //! [in] Only decode messages up to this level (NULL: all)
+    const char * const Level,
+    //! [in] Only decode messages from this library (NULL: all)
+    const char * const Lib
+) {
+   //! \return Number of messages decoded, -1 on error (unknown level or library, not a binary log file)
+   TApp_LogBinHeader     head;
+   TApp_LogBinDef        def;
+   TApp_LogBinMsg        msg;
+   TApp_LogBinDecodeFmt *fmts = NULL, *libs = NULL, key, *fmt;
+   int                   nfmt = 0, mfmt = 0, nlib = 0, mlib = 0, nmsg = 0, multi = FALSE, first = -1;
+   int                   level = APP_QUIET, lib = -1;
+   char                 *args = NULL;
+   const char           *name;
+   size_t                argsize = 0;
+
+   // Level filter, by name or number
+   if (Level) {
+      char *end = NULL;
+      level = strtol(Level, &end, 10);
+      if (end == Level) {
+         for(level = APP_EXTRA; level >= APP_ALWAYS && strncasecmp(Level, AppLevelNames[level], strlen(AppLevelNames[level])); level--);
+      }
+      if (level < APP_ALWAYS || level > APP_EXTRA) {
+         App_Log(APP_ERROR, "%s: Unknown level %s\n", __func__, Level);
+         return -1;
+      }
+   }
+
+   FILE *in = fopen(File, "r");
+   if (!in) {
+      App_Log(APP_ERROR, "%s: Unable to open binary log file %s\n", __func__, File);
+      return -1;
+   }
+   if (fread(&head, sizeof(head), 1, in) != 1 || strncmp(head.Magic, APP_LOGBIN_MAGIC, 7) || head.Magic[7] != APP_LOGBIN_VERSION) {
+      App_Log(APP_ERROR, "%s: %s is not a binary log file (or unsupported version)\n", __func__, File);
+      fclose(in);
+      return -1;
+   }
+
+   // Library filter, run time libraries are looked up by name once the file is read
+   if (Lib) {
+      for(lib = 0; lib <= APP_LIBMETA && strcasecmp(Lib, AppLibNames[lib]); lib++);
+   }
+
+   // First pass: get the format strings (a message may come before the definition of its format)
+   uint8_t type;
+   long    start = ftell(in);
+   while (fread(&type, 1, 1, in) == 1) {
+      fseek(in, -1, SEEK_CUR);
+      if (type == APP_LOGBIN_DEF) {
+         if (fread(&def, sizeof(def), 1, in) != 1) break;
+         if (nfmt == mfmt) {
+            mfmt = mfmt ? mfmt * 2 : 256;
+            fmts = (TApp_LogBinDecodeFmt*)realloc(fmts, mfmt * sizeof(*fmts));
+         }
+         fmts[nfmt].Rank = def.Rank;
+         fmts[nfmt].Fmt = def.Fmt;
+         fmts[nfmt].Format = (char*)malloc(def.Len + 1);
+         if (fread(fmts[nfmt].Format, 1, def.Len, in) != def.Len) break;
+         fmts[nfmt++].Format[def.Len] = '\0';
+      } else if (type == APP_LOGBIN_LIB) {
+         if (fread(&def, sizeof(def), 1, in) != 1) break;
+         if (nlib == mlib) {
+            mlib = mlib ? mlib * 2 : 64;
+            libs = (TApp_LogBinDecodeFmt*)realloc(libs, mlib * sizeof(*libs));
+         }
+         libs[nlib].Rank = def.Rank;
+         libs[nlib].Fmt = def.Fmt;
+         libs[nlib].Format = (char*)malloc(def.Len + 1);
+         if (fread(libs[nlib].Format, 1, def.Len, in) != def.Len) break;
+         libs[nlib++].Format[def.Len] = '\0';
+      } else if (type == APP_LOGBIN_MSG) {
+         if (fread(&msg, sizeof(msg), 1, in) != 1) break;
+         if (first == -1) first = msg.Rank;
+         if (msg.Rank != first) multi = TRUE;
+         fseek(in, msg.Len, SEEK_CUR);
+      } else {
+         App_Log(APP_WARNING, "%s: Corrupted record at offset %li, stopping\n", __func__, ftell(in));
+         break;
+      }
+   }
+   if (nfmt) qsort(fmts, nfmt, sizeof(*fmts), App_LogBinaryCmp);
+   if (nlib) qsort(libs, nlib, sizeof(*libs), App_LogBinaryCmp);
+
+   // Run time libraries are only known by name
+   if (Lib && lib > APP_LIBMETA) {
+      int l;
+      for(l = 0; l < nlib && strcasecmp(Lib, libs[l].Format); l++);
+      if (l >= nlib) {
+         App_Log(APP_ERROR, "%s: Unknown library %s\n", __func__, Lib);
+         for(int f = 0; f < nfmt; f++) free(fmts[f].Format);
+         for(int f = 0; f < nlib; f++) free(libs[f].Format);
+         APP_FREE(fmts);
+         APP_FREE(libs);
+         fclose(in);
+         return -1;
+      }
+   }
+
+   // Second pass: print the messages
+   fseek(in, start, SEEK_SET);
+   while (fread(&type, 1, 1, in) == 1) {
+      fseek(in, -1, SEEK_CUR);
+      if (type == APP_LOGBIN_DEF || type == APP_LOGBIN_LIB) {
+         if (fread(&def, sizeof(def), 1, in) != 1) break;
+         fseek(in, def.Len, SEEK_CUR);
+         continue;
+      } else if (type != APP_LOGBIN_MSG || fread(&msg, sizeof(msg), 1, in) != 1) {
+         break;
+      }
+      if (msg.Len > argsize) {
+         argsize = msg.Len;
+         args = (char*)realloc(args, argsize);
+      }
+      if (fread(args, 1, msg.Len, in) != msg.Len) break;
+
+      // Level and library index the name tables
+      if (msg.Level < APP_VERBATIM || msg.Level > APP_EXTRA || msg.Lib >= APP_LIBSMAX) {
+         App_Log(APP_WARNING, "%s: Invalid record at offset %li (level %d, library %u), stopping\n", __func__, ftell(in), msg.Level, msg.Lib);
+         break;
+      }
+
+      // Name of a run time library as defined by the rank
+      name = NULL;
+      if (msg.Lib > APP_LIBMETA) {
+         key.Rank = msg.Rank;
+         key.Fmt = msg.Lib;
+         if ((fmt = nlib ? (TApp_LogBinDecodeFmt*)bsearch(&key, libs, nlib, sizeof(*libs), App_LogBinaryCmp) : NULL)) name = fmt->Format;
+      }
+
+      if ((Rank >= 0 && msg.Rank != Rank) || (msg.Level > level && msg.Level >= APP_ALWAYS)
+         || (Lib && (lib <= APP_LIBMETA ? msg.Lib != lib : !name || strcasecmp(Lib, name)))) {
+         continue;
+      }
+
+      if (msg.Level >= APP_ALWAYS) {
+         char   time[32];
+         time_t sec;
+         struct tm *lctm;
+         int64_t diff = msg.Time - head.Start;
+
+         time[0] = '\0';
+         switch (head.LogTime) {
+            case APP_DATETIME:
+               sec = msg.Time / 1000000;
+               lctm = head.UTC ? gmtime(&sec) : localtime(&sec);
+               strftime(time, 32, "%c ", lctm);
+               break;
+            case APP_TIME:
+               sec = diff / 1000000;
+               lctm = head.UTC ? gmtime(&sec) : localtime(&sec);
+               strftime(time, 32, "%T ", lctm);
+               break;
+            case APP_SECOND:  snprintf(time, 32, "%-8.3f ", diff / 1000000.0); break;
+            case APP_MSECOND: snprintf(time, 32, "%-8li ", (long)(diff / 1000)); break;
+            default: break;
+         }
+         fputs(time, Out);
+         if (multi) fprintf(Out, "P%03d", msg.Rank);
+         if (msg.Flags & APP_LOGBIN_THREAD) fprintf(Out, "T%03d", msg.Thread);
+         fprintf(Out, "%s(%s) ", (multi || msg.Flags & APP_LOGBIN_THREAD) ? " " : "", AppLevelNames[msg.Level]);
+         if (msg.Step) fprintf(Out, "#%d ", msg.Step);
+         if (msg.Lib <= APP_LIBMETA) {
+            fputs(AppLibLog[msg.Lib], Out);
+         } else if (name) {
+            for(const char *c = name; *c; c++) fputc(toupper(*c), Out);
+            fputc('|', Out);
+         }
+      }
+
+      if (msg.Fmt == APP_LOGBIN_RAW) {
+         App_LogBinaryPrint(Out, "%s", args, msg.Len);
+      } else {
+         key.Rank = msg.Rank;
+         key.Fmt = msg.Fmt;
+         if ((fmt = nfmt ? (TApp_LogBinDecodeFmt*)bsearch(&key, fmts, nfmt, sizeof(*fmts), App_LogBinaryCmp) : NULL)) {
+            App_LogBinaryPrint(Out, fmt->Format, args, msg.Len);
+         } else {
+            fprintf(Out, "(missing format %u)\n", msg.Fmt);
+         }
+      }
+      nmsg++;
+   }
+
+   for(int f = 0; f < nfmt; f++) free(fmts[f].Format);
+   for(int f = 0; f < nlib; f++) free(libs[f].Format);
+   APP_FREE(fmts);
+   APP_FREE(libs);
+   APP_FREE(args);
+   fclose(in);
+
+   return nmsg;
+}
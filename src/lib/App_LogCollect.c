@@ -0,0 +1,167 @@
+//! \file
+//! Deferred collective error agreement
+//!
+//! By default, every \ref Lib_Log call with a level above APP_COLLECT blocks in an MPI_Allreduce on App->Comm to
+//! agree on the most severe level. In deferred mode (APP_LOG_COLLECT=DEFER), these messages only keep the most
+//! severe level (and its message) seen by the rank. At each checkpoint (\ref App_LogStep or \ref App_LogCollectSync,
+//! collective), the agreement of the previous checkpoint is completed and the one of the messages since then is
+//! started with a single MPI_Iallreduce, which completes while the ranks carry on. Once completed, every rank
+//! logs its message at the agreed level and the tolerance level applies, all ranks exiting at the same checkpoint.
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <pthread.h>
+
+#include "App.h"
+#include "App_Log.h"
+#include "str.h"
+
+#define APP_LOGCOLLECT_MSG 1024                 ///< Maximum length of a deferred message
+
+//! Deferred messages of an agreement
+typedef struct {
+   int      Level;                              ///< Most severe level of this rank (agreed level once completed)
+   TApp_Lib Lib;                                ///< Library of the most severe message
+   char     Msg[APP_LOGCOLLECT_MSG];            ///< Most severe message of this rank
+} TApp_LogCollect;
+
+static TApp_LogCollect  AppLogCollect[2] = { { .Level = APP_QUIET }, { .Level = APP_QUIET } };   ///< Messages since the last checkpoint, agreement in flight
+static pthread_mutex_t  AppLogCollectMutex = PTHREAD_MUTEX_INITIALIZER;
+static __thread int     AppLogCollectAgreed = APP_QUIET;                       ///< Agreed level of the message being logged
+#ifdef HAVE_MPI
+static MPI_Request      AppLogCollectReq = MPI_REQUEST_NULL;                   ///< Agreement in flight
+static int              AppLogCollectLevel = APP_QUIET;                        ///< Level sent with the agreement in flight
+#endif
+
+//! Configure the deferred collective error agreement
+int App_LogCollect(
+    //! [in] Defer the agreement of APP_COLLECT messages to the checkpoints (FALSE: agree on every message)
+    const int Defer
+) {
+   //! \return Previous mode
+   //! \note With deferral, \ref App_LogStep is collective on App->Comm
+   int pd = App->LogCollect;
+
+   App->LogCollect = Defer;
+
+   return pd;
+}
+
+//! Keep an APP_COLLECT message until the next checkpoint
+int App_LogCollectDefer(
+    //! [in] Library id
+    const TApp_Lib Lib,
+    //! [in] Message level, without APP_COLLECT
+    const TApp_LogLevel Level,
+    //! [in] printf style format string
+    const char * const Format,
+    //! [in] Variables referrenced in the format string
+    va_list Args
+) {
+   //! \return Level the message has to be logged at, APP_QUIET if kept
+   va_list args;
+
+   // Agreed message being logged
+   if (AppLogCollectAgreed != APP_QUIET) return AppLogCollectAgreed;
+
+   pthread_mutex_lock(&AppLogCollectMutex);
+   if (Level < AppLogCollect[0].Level) {
+      AppLogCollect[0].Level = Level;
+      AppLogCollect[0].Lib = Lib;
+      va_copy(args, Args);
+      vsnprintf(AppLogCollect[0].Msg, APP_LOGCOLLECT_MSG, Format, args);
+      va_end(args);
+   }
+   pthread_mutex_unlock(&AppLogCollectMutex);
+
+   return APP_QUIET;
+}
+
+//! Log the message of this rank at the agreed level, and exit if above the tolerance level
+static void App_LogCollectApply(
+    //! [in] Agreement
+    TApp_LogCollect * const Coll,
+    //! [in] Agreed level
+    const int Level,
+    //! [in] Exit if above the tolerance level (the same on all ranks)
+    const int Exit
+) {
+   if (Level == APP_QUIET) return;
+
+   if (Coll->Level != APP_QUIET) {
+      AppLogCollectAgreed = Level;
+      Lib_Log(Coll->Lib, Level + APP_COLLECT, "%s", Coll->Msg);
+      AppLogCollectAgreed = APP_QUIET;
+   }
+   Coll->Level = APP_QUIET;
+
+   if (Exit && App->Tolerance <= Level && (Level == APP_FATAL || Level == APP_SYSTEM || Level == APP_ERROR)) {
+      App_LogRecorderDump(FALSE);
+      App_End(APP_EXIT + Level);
+   }
+}
+
+//! Complete the agreement in flight
+static void App_LogCollectWait(
+    //! [in] Exit if above the tolerance level
+    const int Exit
+) {
+#ifdef HAVE_MPI
+   if (AppLogCollectReq == MPI_REQUEST_NULL) return;
+
+   MPI_Wait(&AppLogCollectReq, MPI_STATUS_IGNORE);
+   App_LogCollectApply(&AppLogCollect[1], AppLogCollectLevel, Exit);
+#else
+   (void)Exit;
+#endif
+}
+
+//! Checkpoint of the deferred agreement (collective on App->Comm)
+void App_LogCollectSync(
+    //! [in] Wait for the agreement on the messages since the last checkpoint (FALSE: completed at the next checkpoint)
+    const int Wait
+) {
+   //! \note Ranks exit here if the agreed level is above the tolerance level
+   if (!App->LogCollect) return;
+
+   App_LogCollectWait(TRUE);
+
+   // Messages since the last checkpoint are now in flight
+   pthread_mutex_lock(&AppLogCollectMutex);
+   AppLogCollect[1] = AppLogCollect[0];
+   AppLogCollect[0].Level = APP_QUIET;
+   pthread_mutex_unlock(&AppLogCollectMutex);
+
+#ifdef HAVE_MPI
+   if (App_IsMPI()) {
+      AppLogCollectLevel = AppLogCollect[1].Level;
+      MPI_Iallreduce(MPI_IN_PLACE, &AppLogCollectLevel, 1, MPI_INT, MPI_MIN, App->Comm, &AppLogCollectReq);
+      if (Wait) App_LogCollectWait(TRUE);
+      return;
+   }
+#endif
+   (void)Wait;
+   App_LogCollectApply(&AppLogCollect[1], AppLogCollect[1].Level, TRUE);
+}
+
+//! Complete the last agreements, without exiting
+void App_LogCollectEnd(
+    //! [in] Called by every rank of App->Comm, the last messages are agreed on collectively
+    const int Collective
+) {
+   if (!App->LogCollect) return;
+
+   if (Collective) {
+      App_LogCollectWait(FALSE);
+#ifdef HAVE_MPI
+      int level = AppLogCollect[0].Level;
+      MPI_Allreduce(MPI_IN_PLACE, &level, 1, MPI_INT, MPI_MIN, App->Comm);
+      App_LogCollectApply(&AppLogCollect[0], level, FALSE);
+#endif
+   } else {
+      // Other ranks are gone, log our messages at our own level
+      App_LogCollectApply(&AppLogCollect[1], AppLogCollect[1].Level, FALSE);
+      App_LogCollectApply(&AppLogCollect[0], AppLogCollect[0].Level, FALSE);
+   }
+}
@@ -0,0 +1,202 @@
+//! \file
+//! Runtime log filter
+//!
+//! A filter (APP_LOG_FILTER or \ref App_LogFilter) is a ';' separated list of rules [+|-]field:regex, where the field is
+//! lib (library name), msg (format string of the message) or site (file:line of the call site). Rules are extended,
+//! case insensitive regular expressions compiled once. A message matched by an include rule (+, default) is logged,
+//! one matched by an exclude rule (-) is not, the last matching rule deciding. Messages matched by no rule are logged,
+//! unless the filter has include rules. ie: "+lib:^gmm$;-msg:^Iteration" keeps the gmm messages but the iteration ones.
+//!
+//! The filter only applies to the messages above APP_WARNING (INFO to EXTRA), within the log level of their library.
+//! It is evaluated before formatting, once per call site and filter, \ref Lib_Log caches the result in the call site table.
+//! Two cases are evaluated on every call, after formatting, the msg rules then matching the formatted message:
+//!   - calls without a site of their own (\ref Lib_Log function, Fortran), which share one entry per format string and
+//!     for which site is "?:0"
+//!   - formats without literal text (ie: "%s\n"), which say nothing about the message
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <regex.h>
+#include <pthread.h>
+
+#include "App.h"
+#include "App_Log.h"
+#include "str.h"
+
+#define APP_LOGFILTER_MAX 32                    ///< Maximum number of rules of a filter
+
+//! Field matched by a rule
+typedef enum {
+   APP_LOGFILTER_LIB = 0,
+   APP_LOGFILTER_MSG = 1,
+   APP_LOGFILTER_SITE = 2
+} TApp_LogFilterField;
+
+//! Filter rule
+typedef struct {
+   int                 Include;                 ///< Include (TRUE) or exclude (FALSE) the matching messages
+   TApp_LogFilterField Field;                   ///< Field matched
+   regex_t             Re;                      ///< Compiled regular expression
+} TApp_LogFilterRule;
+
+static TApp_LogFilterRule AppLogFilterRules[APP_LOGFILTER_MAX];   ///< Rules of the filter
+static int                AppLogFilterNb = 0;                     ///< Number of rules
+static int                AppLogFilterDefault = TRUE;             ///< Messages matched by no rule are logged
+static int                AppLogFilterMsg = FALSE;                ///< The filter has msg rules
+static pthread_mutex_t    AppLogFilterMutex = PTHREAD_MUTEX_INITIALIZER;
+
+//! Set the runtime log filter
+int App_LogFilter(
+    //! [in] Filter rules ([+|-]lib|msg|site:regex;...), NULL or empty to remove the filter
+    const char * const Filter
+) {
+   //! \return APP_OK, or APP_ERR if a rule is invalid (the previous filter is kept)
+   //! \note The call site results cached with the previous filter are dropped
+   TApp_LogFilterRule rules[APP_LOGFILTER_MAX];
+   char  spec[APP_BUFMAX], *tok, *save = NULL, *re;
+   int   nb = 0, incl = FALSE, msg = FALSE, ok = TRUE;
+
+   strncpy(spec, Filter ? Filter : "", APP_BUFMAX - 1);
+   spec[APP_BUFMAX - 1] = '\0';
+
+   for(tok = strtok_r(spec, ";", &save); tok; tok = strtok_r(NULL, ";", &save)) {
+      while (*tok == ' ') tok++;
+      if (!*tok) continue;
+
+      if (nb >= APP_LOGFILTER_MAX || !(re = strchr(tok, ':'))) {
+         ok = FALSE;
+         break;
+      }
+      rules[nb].Include = *tok != '-';
+      if (*tok == '+' || *tok == '-') tok++;
+
+      if (re - tok == 3 && strncasecmp(tok, "lib", 3) == 0) {
+         rules[nb].Field = APP_LOGFILTER_LIB;
+      } else if (re - tok == 3 && strncasecmp(tok, "msg", 3) == 0) {
+         rules[nb].Field = APP_LOGFILTER_MSG;
+      } else if (re - tok == 4 && strncasecmp(tok, "site", 4) == 0) {
+         rules[nb].Field = APP_LOGFILTER_SITE;
+      } else {
+         ok = FALSE;
+         break;
+      }
+      if (regcomp(&rules[nb].Re, re + 1, REG_EXTENDED | REG_NOSUB | REG_ICASE) != 0) {
+         ok = FALSE;
+         break;
+      }
+      msg |= rules[nb].Field == APP_LOGFILTER_MSG;
+      incl |= rules[nb++].Include;
+   }
+
+   if (!ok) {
+      while (nb--) regfree(&rules[nb].Re);
+      return APP_ERR;
+   }
+
+   pthread_mutex_lock(&AppLogFilterMutex);
+   for(int r = 0; r < AppLogFilterNb; r++) regfree(&AppLogFilterRules[r].Re);
+   memcpy(AppLogFilterRules, rules, nb * sizeof(*rules));
+   AppLogFilterNb = nb;
+   AppLogFilterDefault = !incl;
+   AppLogFilterMsg = msg;
+
+   // A new generation drops the cached results
+   App->LogFilter = nb ? (App->LogFilter & 0x1FFFFFFF) + 1 : 0;
+   pthread_mutex_unlock(&AppLogFilterMutex);
+
+   return APP_OK;
+}
+
+//! Check if a format string has literal text the msg rules can match
+int App_LogFilterLiteral(
+    //! [in] printf style format string
+    const char * const Format
+) {
+   //! \return TRUE if the format has text other than conversions and blanks
+   for(const char *c = Format; *c; c++) {
+      if (*c == '%') {
+         if (*++c == '%') return TRUE;
+         // Skip flags, width, precision and length up to the conversion
+         while (*c && !strchr("diouxXeEfFgGaAcspn", *c)) c++;
+         if (!*c) break;
+      } else if (*c != ' ' && *c != '\t' && *c != '\n') {
+         return TRUE;
+      }
+   }
+   return FALSE;
+}
+
+//! Evaluate the rules of the filter
+static int App_LogFilterEval(
+    //! [in] Source file of the call site (NULL if unknown)
+    const char * const File,
+    //! [in] Source line of the call site
+    const int Line,
+    //! [in] Library id
+    const TApp_Lib Lib,
+    //! [in] Text matched by the msg rules
+    const char * const Msg
+) {
+   //! \return TRUE if the message is logged
+   char site[4096];
+   int  allow;
+
+   snprintf(site, 4096, "%s:%d", File ? File : "?", Line);
+
+   pthread_mutex_lock(&AppLogFilterMutex);
+   allow = AppLogFilterDefault;
+   for(int r = 0; r < AppLogFilterNb; r++) {
+      const char *str = AppLogFilterRules[r].Field == APP_LOGFILTER_LIB ? AppLibNames[Lib] :
+                        AppLogFilterRules[r].Field == APP_LOGFILTER_MSG ? Msg : site;
+
+      if (regexec(&AppLogFilterRules[r].Re, str, 0, NULL, 0) == 0) allow = AppLogFilterRules[r].Include;
+   }
+   pthread_mutex_unlock(&AppLogFilterMutex);
+
+   return allow;
+}
+
+//! Check if the messages of a call site pass the log filter
+int App_LogFilterMatch(
+    //! [in] Source file of the call site (NULL if unknown)
+    const char * const File,
+    //! [in] Source line of the call site
+    const int Line,
+    //! [in] Library id
+    const TApp_Lib Lib,
+    //! [in] printf style format string
+    const char * const Format
+) {
+   //! \return TRUE if the messages are logged
+   //! \note The msg rules match the format string, the result holds for every message of the call site
+   return App_LogFilterEval(File, Line, Lib, Format);
+}
+
+//! Check if a message passes the log filter, the msg rules matching the formatted message
+int App_LogFilterMatchV(
+    //! [in] Source file of the call site (NULL if unknown)
+    const char * const File,
+    //! [in] Source line of the call site
+    const int Line,
+    //! [in] Library id
+    const TApp_Lib Lib,
+    //! [in] printf style format string
+    const char * const Format,
+    //! [in] Variables referrenced in the format string
+    va_list Args
+) {
+   //! \return TRUE if the message is logged
+   //! \note The message is only formatted if the filter has msg rules, the result must not be cached
+   char    msg[APP_BUFMAX];
+   va_list args;
+
+   if (!AppLogFilterMsg) return App_LogFilterEval(File, Line, Lib, Format);
+
+   va_copy(args, Args);
+   vsnprintf(msg, APP_BUFMAX, Format, args);
+   va_end(args);
+
+   return App_LogFilterEval(File, Line, Lib, msg);
+}
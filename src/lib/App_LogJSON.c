@@ -0,0 +1,190 @@
+//! \file
+//! Structured NDJSON log format
+//!
+//! In JSON mode (APP_LOG_FORMAT=JSON), \ref Lib_Log writes every message as one JSON object per line:
+//!
+//!    {"time":"2024-05-01T12:00:00.123Z","rank":0,"component":"model","thread":0,"step":12,"lib":"main","level":"INFO","msg":"..."}
+//!
+//! The time is always UTC. The rank, component, thread and step fields are encoded once per thread and only
+//! rebuilt when one of them changes, and the calendar part of the time only when the second changes, so the
+//! extra cost over the text format is mostly the escape of the message. Trailing newlines of the message are dropped.
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include "App.h"
+#include "App_Log.h"
+#include "str.h"
+
+//! Per thread cache of the fixed parts of the records
+typedef struct {
+   int     Init;                               ///< Fields are valid
+   int     Rank;                               ///< Rank the fields were built for
+   int     Thread;                             ///< Thread the fields were built for
+   int     Step;                               ///< Step the fields were built for
+   const char *Component;                      ///< Component the fields were built for
+   char    Fields[320];                        ///< Rank, component, thread and step fields ("\",\"rank\":0,...,\"step\":12,")
+   int     FieldsLen;
+   time_t  TimeSec;                            ///< Second the time part was built for
+   char    Time[32];                           ///< Time up to the second ("2024-05-01T12:00:00")
+   int     TimeLen;
+} TApp_LogJSONCache;
+
+static __thread TApp_LogJSONCache AppLogJSONCache;           ///< Per thread fixed parts
+static __thread char   *AppLogJSONBuf = NULL;                ///< Per thread record buffer
+static __thread size_t  AppLogJSONBufSize = 0;               ///< Per thread record buffer size
+static __thread char   *AppLogJSONMsg = NULL;                ///< Per thread message buffer
+static __thread size_t  AppLogJSONMsgSize = 0;               ///< Per thread message buffer size
+
+static const char AppLogJSONHex[] = "0123456789abcdef";
+
+//! Make sure a per thread buffer can hold a given length
+static inline int App_LogJSONReserve(char **Buf, size_t *Size, size_t Len) {
+
+   if (Len > *Size) {
+      char *buf = (char*)realloc(*Buf, Len + 1024);
+      if (!buf) return FALSE;
+      *Buf = buf;
+      *Size = Len + 1024;
+   }
+   return TRUE;
+}
+
+//! Escape a string for a JSON string value
+size_t App_LogJSONEscape(
+    //! [out] Escaped string (at least 6 times the length of the string)
+    char *Out,
+    //! [in] String to escape
+    const char *Str,
+    //! [in] Length of the string
+    size_t Len
+) {
+   //! \return Length of the escaped string
+   char *o = Out;
+
+   for(size_t i = 0; i < Len; i++) {
+      unsigned char c = Str[i];
+
+      if (c >= 0x20 && c != '"' && c != '\\') {
+         *o++ = c;
+         continue;
+      }
+      *o++ = '\\';
+      switch(c) {
+         case '"' : *o++ = '"'; break;
+         case '\\': *o++ = '\\'; break;
+         case '\n': *o++ = 'n'; break;
+         case '\r': *o++ = 'r'; break;
+         case '\t': *o++ = 't'; break;
+         default:
+            *o++ = 'u'; *o++ = '0'; *o++ = '0';
+            *o++ = AppLogJSONHex[c >> 4];
+            *o++ = AppLogJSONHex[c & 0xF];
+      }
+   }
+   return o - Out;
+}
+
+//! Rebuild the cached fields if the rank, component, thread or step changed
+static void App_LogJSONFields(
+    //! [in] Prefix cache of the calling thread
+    TApp_LogJSONCache * const Cache,
+    //! [in] Thread id
+    const int Thread
+) {
+   const char *component = App->Name ? App->Name : "";
+   char        name[6 * APP_MAX_COMPONENT_NAME_LEN + 1];
+
+#ifdef HAVE_MPI
+   if (App->SelfComponent) component = App->SelfComponent->name;
+#endif
+
+   if (Cache->Init && Cache->Rank == App->RankMPI && Cache->Thread == Thread && Cache->Step == App->Step && Cache->Component == component) {
+      return;
+   }
+
+   int len = App_LogJSONEscape(name, component, MIN(strlen(component), APP_MAX_COMPONENT_NAME_LEN));
+   name[len] = '\0';
+
+   Cache->FieldsLen = snprintf(Cache->Fields, sizeof(Cache->Fields), "\",\"rank\":%d,\"component\":\"%s\",\"thread\":%d,\"step\":%d,",
+      App->RankMPI, name, Thread, App->Step);
+   Cache->FieldsLen = MIN(Cache->FieldsLen, (int)sizeof(Cache->Fields) - 1);
+   Cache->Rank = App->RankMPI;
+   Cache->Thread = Thread;
+   Cache->Step = App->Step;
+   Cache->Component = component;
+   Cache->Init = TRUE;
+}
+
+//! Build a JSON record
+int App_LogJSONRecord(
+    //! [out] Record (per thread buffer)
+    char **Rec,
+    //! [in] Library id
+    const TApp_Lib Lib,
+    //! [in] Message level
+    const TApp_LogLevel Level,
+    //! [in] Thread id
+    const int Thread,
+    //! [in] printf style format string
+    const char * const Format,
+    //! [in] Variables referrenced in the format string
+    va_list Args
+) {
+   //! \return Record length, -1 on error
+   TApp_LogJSONCache *cache = &AppLogJSONCache;
+   struct timespec    now;
+   struct tm          tm;
+   va_list            args;
+   const char        *lib = AppLibNames[Lib];
+   const char        *level = Level >= APP_ALWAYS && Level <= APP_EXTRA ? AppLevelNames[Level] : "VERBATIM";
+   int                n = -1;
+
+   // Format the message
+   for(int pass = 0; pass < 2 && n < 0; pass++) {
+      va_copy(args, Args);
+      n = vsnprintf(AppLogJSONMsg, AppLogJSONMsgSize, Format, args);
+      va_end(args);
+      if (n < 0) return -1;
+      if ((size_t)n >= AppLogJSONMsgSize) {
+         if (!App_LogJSONReserve(&AppLogJSONMsg, &AppLogJSONMsgSize, n + 1)) return -1;
+         n = -1;
+      }
+   }
+   if (n < 0) return -1;
+   while (n && (AppLogJSONMsg[n - 1] == '\n' || AppLogJSONMsg[n - 1] == '\r')) n--;
+
+   if (!App_LogJSONReserve(&AppLogJSONBuf, &AppLogJSONBufSize, 512 + strlen(lib) + 6 * (size_t)n)) return -1;
+
+   App_LogJSONFields(cache, Thread);
+
+   clock_gettime(CLOCK_REALTIME, &now);
+   if (now.tv_sec != cache->TimeSec) {
+      cache->TimeSec = now.tv_sec;
+      gmtime_r(&now.tv_sec, &tm);
+      cache->TimeLen = strftime(cache->Time, sizeof(cache->Time), "%Y-%m-%dT%H:%M:%S", &tm);
+   }
+
+   char *o = AppLogJSONBuf;
+   memcpy(o, "{\"time\":\"", 9); o += 9;
+   memcpy(o, cache->Time, cache->TimeLen); o += cache->TimeLen;
+   int ms = now.tv_nsec / 1000000;
+   *o++ = '.';
+   *o++ = '0' + ms / 100;
+   *o++ = '0' + ms / 10 % 10;
+   *o++ = '0' + ms % 10;
+   *o++ = 'Z';
+   memcpy(o, cache->Fields, cache->FieldsLen); o += cache->FieldsLen;
+   memcpy(o, "\"lib\":\"", 7); o += 7;
+   o += App_LogJSONEscape(o, lib, strlen(lib));
+   memcpy(o, "\",\"level\":\"", 11); o += 11;
+   memcpy(o, level, strlen(level)); o += strlen(level);
+   memcpy(o, "\",\"msg\":\"", 9); o += 9;
+   o += App_LogJSONEscape(o, AppLogJSONMsg, n);
+   memcpy(o, "\"}\n", 3); o += 3;
+
+   *Rec = AppLogJSONBuf;
+   return o - AppLogJSONBuf;
+}
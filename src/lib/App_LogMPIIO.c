@@ -0,0 +1,256 @@
+//! \file
+//! MPI-IO shared log file
+//!
+//! When enabled (APP_LOG_MPIIO), every rank writes its records into a memory buffer, and all the
+//! ranks write to a single log file opened with MPI-IO, without any rank calling fopen on it.
+//! At step boundaries (\ref App_LogStep) and in \ref App_End, the buffers are written collectively
+//! at offsets given by an exclusive scan of their sizes, which keeps the records of a step ordered
+//! by rank. In between, a rank whose buffer exceeds its size (or that logs an error) appends it
+//! with a non-blocking write through the shared file pointer.
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "App.h"
+#include "App_Log.h"
+#include "str.h"
+
+typedef enum {
+   APP_LOGMPIIO_OFF = 0,                        ///< Not using the shared file
+   APP_LOGMPIIO_ON = 1,                         ///< Using the shared file
+   APP_LOGMPIIO_DONE = 2                        ///< Last collective write done, records are appended through the shared file pointer (stderr once closed)
+} TApp_LogMPIIOState;
+
+#ifdef HAVE_MPI
+static TApp_LogMPIIOState AppLogIOState = APP_LOGMPIIO_OFF;  ///< Shared file state
+static MPI_File         AppLogIOFile = MPI_FILE_NULL;        ///< Shared log file
+static pthread_t        AppLogIOThread;                      ///< Thread allowed to make the MPI calls
+static FILE            *AppLogIOStream = NULL;               ///< Memory stream of the records
+static int              AppLogIOStreamOpen = FALSE;          ///< Memory stream has not been closed
+static char            *AppLogIOBuf[2] = { NULL, NULL };     ///< Double buffer (filling, in flight)
+static size_t           AppLogIOBufSize[2] = { 0, 0 };
+static size_t           AppLogIOLen = 0;                     ///< Length of the filling buffer
+static int              AppLogIOCur = 0;                     ///< Index of the filling buffer
+static MPI_Request      AppLogIOReq = MPI_REQUEST_NULL;      ///< Request of the buffer in flight
+
+//! Memory stream write callback, records are kept until written to the file
+static ssize_t App_LogIOWrite(void *Cookie, const char *Buf, size_t Len) {
+
+   (void)Cookie;
+
+   // Collective writes are over, append through the shared file pointer while it is open
+   if (AppLogIOState == APP_LOGMPIIO_DONE) {
+      if (AppLogIOFile != MPI_FILE_NULL) {
+         MPI_File_write_shared(AppLogIOFile, Buf, Len, MPI_BYTE, MPI_STATUS_IGNORE);
+      } else {
+         fwrite(Buf, 1, Len, stderr);
+      }
+      return Len;
+   }
+
+   if (AppLogIOLen + Len > AppLogIOBufSize[AppLogIOCur]) {
+      size_t size = MAX(AppLogIOLen + Len, 2 * AppLogIOBufSize[AppLogIOCur]);
+      char  *buf = (char*)realloc(AppLogIOBuf[AppLogIOCur], size);
+      if (!buf) return 0;
+      AppLogIOBuf[AppLogIOCur] = buf;
+      AppLogIOBufSize[AppLogIOCur] = size;
+   }
+   memcpy(AppLogIOBuf[AppLogIOCur] + AppLogIOLen, Buf, Len);
+   AppLogIOLen += Len;
+
+   return Len;
+}
+
+//! Memory stream close callback
+static int App_LogIOClose(void *Cookie) {
+
+   (void)Cookie;
+   AppLogIOStreamOpen = FALSE;
+   return 0;
+}
+
+//! Take the filling buffer out, making sure every record written so far is in it
+static char* App_LogIOTake(
+    //! [out] Length of the buffer
+    int *Len
+) {
+   //! \return Buffer (to be written before the next call)
+   char *buf;
+
+   // Records are written whole under the log lock, flushing here cannot split one
+   pthread_mutex_lock(&App_mutex);
+   if (AppLogIOStreamOpen) fflush(AppLogIOStream);
+   buf = AppLogIOBuf[AppLogIOCur];
+   *Len = AppLogIOLen;
+   AppLogIOCur ^= 1;
+   AppLogIOLen = 0;
+   pthread_mutex_unlock(&App_mutex);
+
+   return buf;
+}
+#endif //HAVE_MPI
+
+//! Configure the MPI-IO shared log file
+int App_LogMPIIO(
+    //! [in] Buffer size in bytes after which a rank appends its records between steps (0: every rank writes to the log file)
+    const int Size
+) {
+   //! \return Previous buffer size
+   //! \note Must be called before \ref App_Start, the file is opened collectively there
+   int ps = App->LogMPIIO;
+
+   App->LogMPIIO = Size > 0 ? Size : 0;
+
+   return ps;
+}
+
+//! Open the shared log file (collective on App->Comm)
+int App_LogMPIIOInit(void) {
+   //! \return APP_OK if using the shared file, APP_ERR otherwise
+
+#ifdef HAVE_MPI
+   int err;
+
+   if (AppLogIOState != APP_LOGMPIIO_OFF || !App->LogMPIIO || !App_IsMPI() || App->LogSplit || !App->LogFile
+      || strcmp(App->LogFile, "stdout") == 0 || strcmp(App->LogFile, "stderr") == 0) {
+      return APP_ERR;
+   }
+
+   // Ranks that already opened their stream keep writing to it directly
+   err = App->LogStream != NULL;
+   MPI_Allreduce(MPI_IN_PLACE, &err, 1, MPI_INT, MPI_MAX, App->Comm);
+   if (err) {
+      if (!App->RankMPI) {
+         fprintf(stderr, "(WARNING) Log stream already opened, MPI-IO log file disabled\n");
+      }
+      return APP_ERR;
+   }
+
+   if (MPI_File_open(App->Comm, App->LogFile, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &AppLogIOFile) != MPI_SUCCESS) {
+      if (!App->RankMPI) {
+         fprintf(stderr, "(WARNING) Unable to open log file %s with MPI-IO, every rank will write to it\n", App->LogFile);
+      }
+      return APP_ERR;
+   }
+   MPI_File_set_size(AppLogIOFile, 0);
+
+   cookie_io_functions_t io = { NULL, App_LogIOWrite, NULL, App_LogIOClose };
+   AppLogIOStream = fopencookie(NULL, "w", io);
+   AppLogIOStreamOpen = TRUE;
+   AppLogIOThread = pthread_self();
+   AppLogIOState = APP_LOGMPIIO_ON;
+
+   return APP_OK;
+#else
+   return APP_ERR;
+#endif //HAVE_MPI
+}
+
+//! Get the log stream of this rank when using the shared file
+FILE* App_LogMPIIOOpen(void) {
+   //! \return Log stream, NULL if not using the shared file
+#ifdef HAVE_MPI
+   if (AppLogIOState == APP_LOGMPIIO_ON) {
+      // The file starts with the binary header
+      if (!App->RankMPI && App->LogFormat == APP_LOG_BINARY) {
+         App_LogBinaryHeader(AppLogIOStream);
+      }
+      return AppLogIOStream;
+   }
+#endif
+   return NULL;
+}
+
+//! Append the records of this rank to the shared file if its buffer is full
+void App_LogMPIIOFlush(
+    //! [in] Append whatever the buffer size
+    const int Force
+) {
+#ifdef HAVE_MPI
+   int done = TRUE, len;
+
+   if (AppLogIOState != APP_LOGMPIIO_ON || !pthread_equal(pthread_self(), AppLogIOThread)) return;
+   if (!Force && AppLogIOLen < (size_t)App->LogMPIIO) return;
+
+   // Keep filling until the previous write is done
+   if (AppLogIOReq != MPI_REQUEST_NULL) {
+      MPI_Test(&AppLogIOReq, &done, MPI_STATUS_IGNORE);
+      if (!done) return;
+   }
+
+   char *buf = App_LogIOTake(&len);
+   if (len) {
+      MPI_File_iwrite_shared(AppLogIOFile, buf, len, MPI_BYTE, &AppLogIOReq);
+   }
+#else
+   (void)Force;
+#endif
+}
+
+//! Write the records of every rank to the shared file, ordered by rank (collective on App->Comm)
+int App_LogMPIIOSync(void) {
+   //! \return APP_OK if the records were written, APP_ERR if not using the shared file
+#ifdef HAVE_MPI
+   MPI_Offset base, off = 0, len, total;
+   int        n;
+
+   if (AppLogIOState != APP_LOGMPIIO_ON) return APP_ERR;
+
+   App_LogAsyncFlush();
+
+   // Appended records have to be in before we place ours after them
+   MPI_Wait(&AppLogIOReq, MPI_STATUS_IGNORE);
+   char *buf = App_LogIOTake(&n);
+   len = n;
+   MPI_Barrier(App->Comm);
+   MPI_File_get_position_shared(AppLogIOFile, &base);
+
+   MPI_Exscan(&len, &off, 1, MPI_OFFSET, MPI_SUM, App->Comm);
+   if (!App->RankMPI) off = 0;
+   MPI_Allreduce(&len, &total, 1, MPI_OFFSET, MPI_SUM, App->Comm);
+
+   MPI_File_write_at_all(AppLogIOFile, base + off, buf, n, MPI_BYTE, MPI_STATUS_IGNORE);
+   MPI_File_seek_shared(AppLogIOFile, base + total, MPI_SEEK_SET);
+
+   return APP_OK;
+#else
+   return APP_ERR;
+#endif
+}
+
+//! Write what is left and close the shared file
+void App_LogMPIIOEnd(
+    //! [in] Called by every rank of App->Comm, the last records are written collectively and the file closed
+    const int Collective
+) {
+#ifdef HAVE_MPI
+   int len, nb;
+
+   if (AppLogIOState != APP_LOGMPIIO_ON) return;
+
+   if (Collective && pthread_equal(pthread_self(), AppLogIOThread)) {
+      App_LogMPIIOSync();
+      MPI_File_close(&AppLogIOFile);
+      AppLogIOState = APP_LOGMPIIO_DONE;
+   } else {
+      // Other ranks are not writing collectively anymore, append what is left
+      MPI_Wait(&AppLogIOReq, MPI_STATUS_IGNORE);
+      char *buf = App_LogIOTake(&len);
+      if (len) {
+         MPI_File_write_shared(AppLogIOFile, buf, len, MPI_BYTE, MPI_STATUS_IGNORE);
+      }
+
+      // Closing is collective, a rank alone on the file closes it, the others let go of it, late records go to stderr
+      MPI_Comm_size(App->Comm, &nb);
+      if (nb == 1) {
+         MPI_File_close(&AppLogIOFile);
+      } else {
+         AppLogIOFile = MPI_FILE_NULL;
+      }
+      AppLogIOState = APP_LOGMPIIO_DONE;
+   }
+#else
+   (void)Collective;
+#endif
+}
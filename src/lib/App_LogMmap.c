@@ -0,0 +1,229 @@
+//! \file
+//! Memory mapped log file writer
+//!
+//! When enabled (APP_LOG_MMAP), the log file is mapped in memory once, over a large virtual range, and threads
+//! reserve space for their records with an atomic bump pointer and copy them directly into the mapping, without
+//! stdio locking nor system calls. The file is extended in large chunks (the chunk size) and truncated to the
+//! end of the last record written on \ref App_LogClose (or at exit), once the writers in flight are done.
+//! Since the kernel holds the dirty pages, records written before a crash of the process are in the file,
+//! followed by zeros up to the end of the last chunk.
+//!
+//! The writer only applies to a file this process is the only one writing to (single process, APP_LOG_SPLIT
+//! or aggregating writer ranks) and takes precedence over rotation and compression. The log stream is still
+//! a FILE* (unbuffered) for the callers writing to it.
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "App.h"
+#include "App_Log.h"
+#include "str.h"
+
+#define APP_LOGMMAP_RANGE ((uint64_t)1 << 36)  ///< Mapped virtual range (records past it are written with pwrite)
+
+static volatile int     AppLogMmapOn = FALSE;  ///< Writer is active
+static int              AppLogMmapFd = -1;     ///< Log file descriptor
+static char            *AppLogMmapBase = NULL; ///< Mapping
+static volatile uint64_t AppLogMmapHead = 0;   ///< Next free position (bump pointer)
+static volatile uint64_t AppLogMmapSize = 0;   ///< Allocated file size
+static volatile uint64_t AppLogMmapEnd = 0;    ///< Highest position written
+static volatile int     AppLogMmapWriters = 0; ///< Number of writers in flight
+static pthread_mutex_t  AppLogMmapMutex = PTHREAD_MUTEX_INITIALIZER;
+static FILE            *AppLogMmapStream = NULL;  ///< Log stream, until closed
+static volatile int64_t AppLogMmapLost = 0;    ///< Number of records that could not be written
+
+//! Make sure the file is allocated up to a given position
+static int App_LogMmapExtend(
+    //! [in] End of the reserved space
+    const uint64_t End
+) {
+   //! \return APP_OK if allocated, APP_ERR otherwise
+   int err = 0;
+
+   if (End <= __atomic_load_n(&AppLogMmapSize, __ATOMIC_ACQUIRE)) return APP_OK;
+
+   pthread_mutex_lock(&AppLogMmapMutex);
+   if (End > AppLogMmapSize) {
+      uint64_t size = (End + App->LogMmap - 1) / App->LogMmap * App->LogMmap;
+
+      // Allocate the blocks, writing to a sparse mapping on a full disk would raise SIGBUS
+      if (!(err = posix_fallocate(AppLogMmapFd, AppLogMmapSize, size - AppLogMmapSize))) {
+         __atomic_store_n(&AppLogMmapSize, size, __ATOMIC_RELEASE);
+      }
+   }
+   pthread_mutex_unlock(&AppLogMmapMutex);
+
+   return err ? APP_ERR : APP_OK;
+}
+
+//! Copy a record to the file
+int App_LogMmapPush(
+    //! [in] Record
+    const char *Rec,
+    //! [in] Record length
+    size_t Len
+) {
+   //! \return APP_OK if written, APP_ERR if the caller has to write it itself
+   uint64_t end;
+   int      written = TRUE;
+
+   // Register before checking, so that closing waits for us once it sees us
+   __atomic_add_fetch(&AppLogMmapWriters, 1, __ATOMIC_SEQ_CST);
+   if (!__atomic_load_n(&AppLogMmapOn, __ATOMIC_SEQ_CST)) {
+      __atomic_sub_fetch(&AppLogMmapWriters, 1, __ATOMIC_RELEASE);
+      return APP_ERR;
+   }
+
+   uint64_t pos = __sync_fetch_and_add(&AppLogMmapHead, Len);
+
+   // The space is reserved whatever happens, a record that can not be written is lost
+   if (App_LogMmapExtend(pos + Len) != APP_OK) {
+      written = FALSE;
+   } else if (pos + Len <= APP_LOGMMAP_RANGE) {
+      memcpy(AppLogMmapBase + pos, Rec, Len);
+   } else {
+      written = pwrite(AppLogMmapFd, Rec, Len, pos) == (ssize_t)Len;
+   }
+
+   if (written) {
+      end = __atomic_load_n(&AppLogMmapEnd, __ATOMIC_RELAXED);
+      while (end < pos + Len && !__atomic_compare_exchange_n(&AppLogMmapEnd, &end, pos + Len, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+   } else {
+      __sync_fetch_and_add(&AppLogMmapLost, 1);
+   }
+
+   __atomic_sub_fetch(&AppLogMmapWriters, 1, __ATOMIC_RELEASE);
+   return APP_OK;
+}
+
+//! Stream write callback
+static ssize_t App_LogMmapWrite(void *Cookie, const char *Buf, size_t Len) {
+
+   (void)Cookie;
+
+   if (App_LogMmapPush(Buf, Len) != APP_OK) {
+      // Closed, late messages go to stderr
+      return fwrite(Buf, 1, Len, stderr);
+   }
+   return Len;
+}
+
+//! Stream seek callback, only telling the current position (binary header check)
+static int App_LogMmapSeek(void *Cookie, off64_t *Pos, int Whence) {
+
+   (void)Cookie;
+
+   if (*Pos != 0 || Whence == SEEK_SET) {
+      errno = EINVAL;
+      return -1;
+   }
+   *Pos = __atomic_load_n(&AppLogMmapHead, __ATOMIC_ACQUIRE);
+   return 0;
+}
+
+//! Stream close callback, truncating the file to the end of the records
+static int App_LogMmapClose(void *Cookie) {
+
+   (void)Cookie;
+
+   __atomic_store_n(&AppLogMmapOn, FALSE, __ATOMIC_SEQ_CST);
+   AppLogMmapStream = NULL;
+
+   // Let the writers that got in finish their copy
+   while (__atomic_load_n(&AppLogMmapWriters, __ATOMIC_ACQUIRE)) {
+      sched_yield();
+   }
+
+   munmap(AppLogMmapBase, APP_LOGMMAP_RANGE);
+   AppLogMmapBase = NULL;
+
+   // Past the last record written, records that could not be written at the end are not left as zeros
+   int err = ftruncate(AppLogMmapFd, AppLogMmapEnd);
+   close(AppLogMmapFd);
+   AppLogMmapFd = -1;
+
+   if (AppLogMmapLost) {
+      fprintf(stderr, "(WARNING) %li log records lost, could not extend the log file\n", (long)AppLogMmapLost);
+      AppLogMmapLost = 0;
+   }
+
+   return err;
+}
+
+//! Close the stream at exit if the application did not
+static void App_LogMmapExit(void) {
+
+   if (AppLogMmapStream) {
+      FILE *stream = AppLogMmapStream;
+
+      // Late messages go to stderr
+      if (App->LogStream == stream) App->LogStream = stderr;
+      fclose(stream);
+   }
+}
+
+//! Configure the memory mapped log file writer
+int64_t App_LogMmap(
+    //! [in] Size of the chunks the file is extended by in bytes (0: stdio writer)
+    const int64_t Size
+) {
+   //! \return Previous chunk size
+   //! \note Must be called before the log stream is opened (first message or \ref App_LogOpen)
+   int64_t ps = App->LogMmap;
+
+   App->LogMmap = Size > 0 ? (Size + 4095) / 4096 * 4096 : 0;
+
+   return ps;
+}
+
+//! Open the log file with the memory mapped writer
+FILE* App_LogMmapOpen(
+    //! [in] Log file name
+    const char * const File,
+    //! [in] Open mode ("w" or "a")
+    const char * const Mode
+) {
+   //! \return Log stream, NULL if the file could not be mapped
+   //! \note The caller must be the only writer of the file
+   struct stat st;
+
+   if (!App->LogMmap || AppLogMmapStream) return NULL;
+
+   if ((AppLogMmapFd = open(File, O_RDWR | O_CREAT | (Mode[0] == 'a' ? 0 : O_TRUNC), 0644)) < 0) {
+      return NULL;
+   }
+   if (fstat(AppLogMmapFd, &st) == 0) {
+      AppLogMmapHead = AppLogMmapSize = AppLogMmapEnd = st.st_size;
+   }
+
+   AppLogMmapBase = (char*)mmap(NULL, APP_LOGMMAP_RANGE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, AppLogMmapFd, 0);
+   if (AppLogMmapBase == MAP_FAILED) {
+      AppLogMmapBase = NULL;
+      close(AppLogMmapFd);
+      AppLogMmapFd = -1;
+      return NULL;
+   }
+
+   cookie_io_functions_t io = { NULL, App_LogMmapWrite, App_LogMmapSeek, App_LogMmapClose };
+   if (!(AppLogMmapStream = fopencookie(NULL, "w", io))) {
+      App_LogMmapClose(NULL);
+      return NULL;
+   }
+   // Keep writes through the stream in order with the records copied directly
+   setvbuf(AppLogMmapStream, NULL, _IONBF, 0);
+   __atomic_store_n(&AppLogMmapOn, TRUE, __ATOMIC_RELEASE);
+
+   static int registered = FALSE;
+   if (!registered) {
+      atexit(App_LogMmapExit);
+      registered = TRUE;
+   }
+   return AppLogMmapStream;
+}
@@ -0,0 +1,288 @@
+//! \file
+//! Crash flight recorder
+//!
+//! When enabled (APP_LOG_RECORDER), messages above the log level of their library, up to the recorder level,
+//! are not discarded but formatted into a per thread in-memory ring of fixed size slots, overwriting the oldest
+//! ones, without any lock nor I/O. The rings are only written to the log when \ref Lib_Log aborts the application
+//! (error above the tolerance level), or from the crash handler installed for SIGSEGV, SIGBUS, SIGFPE, SIGILL
+//! and SIGABRT, which then lets the signal take its course. Records of all the threads are dumped in the order
+//! they were logged. Records longer than a slot are truncated.
+//! The crash handler only makes async-signal-safe calls: it writes to the descriptor of the log file cached when
+//! the log stream was opened (stderr if it has none). What is still buffered in the log stream or queued for the
+//! asynchronous writer is not flushed, those records are lost and the dump may land before the last ones written.
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+
+#include "App.h"
+#include "App_Log.h"
+#include "str.h"
+
+#define APP_LOGREC_MAXRING  256                 ///< Maximum number of per thread rings (threads)
+#define APP_LOGREC_SLOT     256                 ///< Slot size (record, sequence number and length)
+
+//! Recorded message
+typedef struct {
+   uint64_t Seq;                                ///< Sequence number, ordering the records of all threads
+   uint32_t Len;                                ///< Record length
+   char     Rec[APP_LOGREC_SLOT - 12];          ///< Record
+} TApp_LogRecSlot;
+
+//! Per thread ring
+typedef struct {
+   TApp_LogRecSlot  *Slots;                     ///< Ring storage
+   uint64_t          Nb;                        ///< Number of slots (power of 2)
+   volatile uint64_t Head;                      ///< Next slot (updated by the owning thread only)
+   volatile uint64_t Tail;                      ///< Slots before this one were already dumped
+} TApp_LogRecRing;
+
+static TApp_LogRecRing *AppLogRecRings[APP_LOGREC_MAXRING];  ///< Registered rings
+static volatile int32_t AppLogRecRingNb = 0;                 ///< Number of registered rings
+static __thread TApp_LogRecRing *AppLogRecRing = NULL;       ///< Ring of the current thread
+static volatile uint64_t AppLogRecSeq = 0;                   ///< Next sequence number
+static volatile int      AppLogRecDumping = FALSE;           ///< A dump is in progress
+static int               AppLogRecTrapped = FALSE;           ///< Crash handler is installed
+static struct sigaction  AppLogRecOld[NSIG];                 ///< Signal actions replaced by the crash handler
+static volatile int      AppLogRecFd = 2;                    ///< Descriptor the crash handler writes to (log file or stderr)
+
+static const int AppLogRecSignals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+
+//! Allocate and register a ring for the current thread
+static TApp_LogRecRing* App_LogRecorderRingNew(void) {
+
+   uint64_t nb = 16;
+   while (nb * APP_LOGREC_SLOT < (uint64_t)App->LogRecorderSize) nb <<= 1;
+
+   int32_t n = __sync_fetch_and_add(&AppLogRecRingNb, 1);
+   if (n >= APP_LOGREC_MAXRING) {
+      __sync_fetch_and_sub(&AppLogRecRingNb, 1);
+      return NULL;
+   }
+
+   TApp_LogRecRing *ring = (TApp_LogRecRing*)calloc(1, sizeof(TApp_LogRecRing));
+   if (ring && !(ring->Slots = (TApp_LogRecSlot*)malloc(nb * sizeof(TApp_LogRecSlot)))) {
+      free(ring);
+      ring = NULL;
+   }
+   if (ring) ring->Nb = nb;
+
+   // Publish even if NULL so the dump does not wait on an empty slot
+   __atomic_store_n(&AppLogRecRings[n], ring, __ATOMIC_RELEASE);
+   return ring;
+}
+
+//! Keep a record in the ring of the current thread
+void App_LogRecorderPush(
+    //! [in] Record
+    const char *Rec,
+    //! [in] Record length
+    size_t Len
+) {
+   TApp_LogRecRing *ring = AppLogRecRing;
+   TApp_LogRecSlot *slot;
+
+   if (!ring) {
+      // Threads over the limit (or out of memory) do not record
+      static __thread int failed = FALSE;
+      if (failed || !(ring = AppLogRecRing = App_LogRecorderRingNew())) {
+         failed = TRUE;
+         return;
+      }
+   }
+
+   slot = &ring->Slots[ring->Head & (ring->Nb - 1)];
+   slot->Len = MIN(Len, sizeof(slot->Rec));
+   memcpy(slot->Rec, Rec, slot->Len);
+   // Keep truncated records on their own line
+   if (slot->Len < Len) slot->Rec[slot->Len - 1] = '\n';
+   slot->Seq = __sync_fetch_and_add(&AppLogRecSeq, 1);
+
+   __atomic_store_n(&ring->Head, ring->Head + 1, __ATOMIC_RELEASE);
+}
+
+//! Write a buffer to the log stream, or to a file descriptor if no stream is given
+static void App_LogRecorderWrite(FILE *Stream, int Fd, const char *Buf, size_t Len) {
+
+   ssize_t n;
+
+   if (Stream) {
+      fwrite(Buf, 1, Len, Stream);
+      return;
+   }
+   while (Len > 0 && (n = write(Fd, Buf, Len)) > 0) {
+      Buf += n;
+      Len -= n;
+   }
+}
+
+//! Cache the file descriptor records can be written to from a signal handler
+void App_LogRecorderStream(
+    //! [in] Log stream just opened (NULL: being closed)
+    FILE *Stream
+) {
+   //! \note The descriptor of the log file, stderr if the log stream has none (memory or cookie stream) or is binary
+   int fd = Stream && Stream != stderr && App->LogFormat != APP_LOG_BINARY ? fileno(Stream) : -1;
+
+   AppLogRecFd = fd >= 0 ? fd : 2;
+}
+
+//! Format a number in a buffer, without the stdio functions that are not async-signal-safe
+static int App_LogRecorderNum(char *Buf, uint64_t Num) {
+   //! \return Number of digits written
+   char digits[20];
+   int  n = 0, len;
+
+   do {
+      digits[n++] = '0' + Num % 10;
+      Num /= 10;
+   } while (Num);
+   for(len = 0; n; len++) Buf[len] = digits[--n];
+   return len;
+}
+
+//! Build a line out of a prefix, a number and a suffix, without the stdio functions
+static int App_LogRecorderLine(char *Buf, const char *Pre, uint64_t Num, const char *Post) {
+   //! \return Line length
+   int len = strlen(Pre);
+
+   memcpy(Buf, Pre, len);
+   len += App_LogRecorderNum(Buf + len, Num);
+   memcpy(Buf + len, Post, strlen(Post));
+   return len + strlen(Post);
+}
+
+//! Write the records of every thread to the log, oldest first
+void App_LogRecorderDump(
+    //! [in] Called from a signal handler, only write to the file descriptor of the log stream (or stderr)
+    const int Crash
+) {
+   //! \note The records are only dumped once
+   uint64_t         pos[APP_LOGREC_MAXRING], end[APP_LOGREC_MAXRING], nb = 0;
+   TApp_LogRecRing *ring;
+   TApp_LogRecSlot *slot, *next;
+   char             head[128];
+   int              r, rn, best = 0, len;
+   FILE            *stream = NULL;
+
+   if (!App->LogRecorder || !__sync_bool_compare_and_swap(&AppLogRecDumping, FALSE, TRUE)) return;
+
+   // Snapshot the rings, records keep coming from the other threads
+   rn = MIN(__atomic_load_n(&AppLogRecRingNb, __ATOMIC_ACQUIRE), APP_LOGREC_MAXRING);
+   for(r = 0; r < rn; r++) {
+      pos[r] = end[r] = 0;
+      if ((ring = __atomic_load_n(&AppLogRecRings[r], __ATOMIC_ACQUIRE))) {
+         end[r] = __atomic_load_n(&ring->Head, __ATOMIC_ACQUIRE);
+         pos[r] = MAX(ring->Tail, end[r] > ring->Nb ? end[r] - ring->Nb : 0);
+         ring->Tail = end[r];
+         nb += end[r] - pos[r];
+      }
+   }
+
+   if (nb) {
+      // Text records do not belong in a binary log
+      if (!Crash && App->LogStream && App->LogFormat != APP_LOG_BINARY) {
+         App_LogAsyncFlush();
+         pthread_mutex_lock(&App_mutex);
+         stream = App->LogStream;
+      }
+      int fd = AppLogRecFd;
+
+      if (App->LogFormat != APP_LOG_JSON) {
+         char post[64] = " messages up to ";
+         strcat(strcat(post, AppLevelNames[App->LogRecorder]), " -----\n");
+         len = App_LogRecorderLine(head, "----- Flight recorder: last ", nb, post);
+         App_LogRecorderWrite(stream, fd, head, len);
+      }
+
+      // Merge the rings on the sequence numbers
+      while (TRUE) {
+         next = NULL;
+         for(r = 0; r < rn; r++) {
+            if (pos[r] < end[r]) {
+               slot = &AppLogRecRings[r]->Slots[pos[r] & (AppLogRecRings[r]->Nb - 1)];
+               if (!next || slot->Seq < next->Seq) {
+                  next = slot;
+                  best = r;
+               }
+            }
+         }
+         if (!next) break;
+         pos[best]++;
+
+         App_LogRecorderWrite(stream, fd, next->Rec, MIN(next->Len, sizeof(next->Rec)));
+      }
+
+      if (App->LogFormat != APP_LOG_JSON) {
+         static const char tail[] = "----- End of flight recorder -----\n";
+         App_LogRecorderWrite(stream, fd, tail, sizeof(tail) - 1);
+      }
+
+      if (stream) {
+         fflush(stream);
+         pthread_mutex_unlock(&App_mutex);
+      }
+   }
+   __atomic_store_n(&AppLogRecDumping, FALSE, __ATOMIC_RELEASE);
+}
+
+//! Crash handler, dumping the records then letting the signal take its course
+static void App_LogRecorderCrash(int Signal) {
+
+   char msg[64];
+   int  len = App_LogRecorderLine(msg, "(FATAL) Caught signal ", Signal, "\n");
+
+   App_LogRecorderWrite(NULL, AppLogRecFd, msg, len);
+   App_LogRecorderDump(TRUE);
+
+   // Raised again with the previous action once we return
+   sigaction(Signal, &AppLogRecOld[Signal], NULL);
+   raise(Signal);
+}
+
+//! Configure the flight recorder
+int App_LogRecorder(
+    //! [in] Recorder level ("INFO", "STAT", "TRIVIAL", "DEBUG", "EXTRA", NULL or "" to disable)
+    const char * const Level,
+    //! [in] Ring size per thread in bytes (0: 64KB)
+    const int Size
+) {
+   //! \return Previous recorder level (0: disabled)
+   //! \note Records are only kept for messages above the log level of their library
+   int pl = App->LogRecorder;
+
+   App->LogRecorder = 0;
+   if (Level && Level[0] != '\0') {
+      for(int l = APP_INFO; l <= APP_EXTRA; l++) {
+         if (strncasecmp(Level, AppLevelNames[l], 4) == 0) {
+            App->LogRecorder = l;
+            break;
+         }
+      }
+      if (!App->LogRecorder && atoi(Level) >= APP_INFO && atoi(Level) <= APP_EXTRA) {
+         App->LogRecorder = atoi(Level);
+      }
+   }
+   if (!App->LogRecorderSize || Size > 0) {
+      App->LogRecorderSize = Size > 0 ? Size : 64 * 1024;
+   }
+
+   // Install the crash handler, unless signals are not to be trapped (APP_NOTRAP)
+   if (App->LogRecorder && !AppLogRecTrapped && App->Signal != -1) {
+      App_LogRecorderStream(App->LogStream);
+
+      struct sigaction act;
+
+      memset(&act, 0, sizeof(act));
+      act.sa_handler = App_LogRecorderCrash;
+      sigemptyset(&act.sa_mask);
+      for(unsigned int s = 0; s < sizeof(AppLogRecSignals) / sizeof(int); s++) {
+         sigaction(AppLogRecSignals[s], &act, &AppLogRecOld[AppLogRecSignals[s]]);
+      }
+      AppLogRecTrapped = TRUE;
+   }
+   return pl;
+}
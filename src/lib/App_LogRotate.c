@@ -0,0 +1,248 @@
+//! \file
+//! Size capped, rotating and compressed log files
+//!
+//! When a segment size is set (APP_LOG_ROTATE), the log file is written in segments. The first segment is the
+//! log file itself and the next ones are named [file].001, [file].002, ... Segments are cut between records, never
+//! within a record or a line, so a segment can exceed the size by one record (or one batch of the asynchronous writer).
+//! Rotation is held while \ref App_End writes its footer box. When the number of segments is capped, the oldest
+//! segment after the first is removed, so the header box of \ref App_Start (first segment) and the footer box of
+//! \ref App_End (last segment) are always kept whole.
+//!
+//! With compression (APP_LOG_COMPRESS), every segment is a gzip stream ([file].gz, [file].001.gz, ...) compressed
+//! as it is written, by the asynchronous writer thread when one is running. Compressed data is only complete once
+//! the segment is closed, at rotation or at exit.
+//!
+//! Rotation and compression only apply to a file this process is the only one writing to (single process,
+//! APP_LOG_SPLIT or aggregating writer ranks) in text or JSON format.
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "App.h"
+#include "App_Log.h"
+#include "str.h"
+
+//! Rotating log file
+typedef struct {
+   char   *File;                               ///< Log file name (first segment)
+   int     Seg;                                ///< Current segment number
+   int64_t Len;                                ///< Length written to the current segment (uncompressed)
+   int     Eol;                                ///< The last record written ends a line
+   FILE   *Fd;                                 ///< Current segment
+#ifdef HAVE_ZLIB
+   gzFile  Gz;                                 ///< Current compressed segment
+#endif
+} TApp_LogRotate;
+
+static FILE         *AppLogRotStream = NULL;   ///< Rotating stream, until closed
+static volatile int  AppLogRotHold = FALSE;    ///< Rotation is held (footer box being written)
+
+//! Get the file name of a segment
+static void App_LogRotateName(
+    //! [in] Rotating log file
+    const TApp_LogRotate * const Rot,
+    //! [in] Segment number
+    const int Seg,
+    //! [out] File name
+    char * const Name,
+    //! [in] Maximum length of the file name
+    const int Len
+) {
+   const char *ext = App->LogCompress ? ".gz" : "";
+
+   if (Seg) {
+      snprintf(Name, Len, "%s.%03d%s", Rot->File, Seg, ext);
+   } else {
+      snprintf(Name, Len, "%s%s", Rot->File, ext);
+   }
+}
+
+//! Open a segment
+static int App_LogRotateSegOpen(
+    //! [in] Rotating log file
+    TApp_LogRotate * const Rot,
+    //! [in] Open mode ("w" or "a")
+    const char * const Mode
+) {
+   //! \return APP_OK if opened, APP_ERR otherwise
+   char        name[4096];
+   struct stat st;
+
+   App_LogRotateName(Rot, Rot->Seg, name, 4096);
+
+   // Appending to an existing segment, count what is already in it
+   Rot->Len = (Mode[0] == 'a' && stat(name, &st) == 0) ? st.st_size : 0;
+
+#ifdef HAVE_ZLIB
+   if (App->LogCompress) {
+      // Appending adds a new gzip member, which gzip readers concatenate
+      return (Rot->Gz = gzopen(name, Mode[0] == 'a' ? "ab" : "wb")) ? APP_OK : APP_ERR;
+   }
+#endif
+   return (Rot->Fd = fopen(name, Mode)) ? APP_OK : APP_ERR;
+}
+
+//! Close the current segment
+static void App_LogRotateSegClose(TApp_LogRotate * const Rot) {
+
+#ifdef HAVE_ZLIB
+   if (Rot->Gz) {
+      gzclose(Rot->Gz);
+      Rot->Gz = NULL;
+   }
+#endif
+   if (Rot->Fd) {
+      fclose(Rot->Fd);
+      Rot->Fd = NULL;
+   }
+}
+
+//! Switch to the next segment, removing the oldest one over the segment count
+static int App_LogRotateNext(TApp_LogRotate * const Rot) {
+   //! \return APP_OK if the next segment is opened, APP_ERR otherwise
+   char name[4096];
+
+   App_LogRotateSegClose(Rot);
+   Rot->Seg++;
+
+   // Keep the first segment (header) and the last ones
+   if (App->LogRotateNb > 1 && Rot->Seg >= App->LogRotateNb) {
+      App_LogRotateName(Rot, Rot->Seg - App->LogRotateNb + 1, name, 4096);
+      remove(name);
+   }
+   return App_LogRotateSegOpen(Rot, "w");
+}
+
+//! Write to the current segment
+static int App_LogRotateOut(TApp_LogRotate * const Rot, const char *Buf, size_t Len) {
+   //! \return TRUE if written
+#ifdef HAVE_ZLIB
+   if (Rot->Gz) {
+      return gzwrite(Rot->Gz, Buf, Len) == (int)Len;
+   }
+#endif
+   return Rot->Fd && fwrite(Buf, 1, Len, Rot->Fd) == Len;
+}
+
+//! Stream write callback, the stream being unbuffered a call holds whole records
+static ssize_t App_LogRotateWrite(void *Cookie, const char *Buf, size_t Len) {
+
+   TApp_LogRotate *rot = (TApp_LogRotate*)Cookie;
+
+   // Cut before the records that do not fit, unless the segment is empty or a line is not finished
+   if (App->LogRotate && rot->Len && rot->Eol && !AppLogRotHold && rot->Len + (int64_t)Len > App->LogRotate) {
+      if (App_LogRotateNext(rot) != APP_OK) return 0;
+   }
+   if (!Len) return 0;
+   if (!App_LogRotateOut(rot, Buf, Len)) return 0;
+   rot->Len += Len;
+   rot->Eol = Buf[Len - 1] == '\n';
+
+   return Len;
+}
+
+//! Stream close callback
+static int App_LogRotateClose(void *Cookie) {
+
+   TApp_LogRotate *rot = (TApp_LogRotate*)Cookie;
+
+   App_LogRotateSegClose(rot);
+   free(rot->File);
+   free(rot);
+   AppLogRotStream = NULL;
+
+   return 0;
+}
+
+//! Close the rotating stream at exit if the application did not
+static void App_LogRotateExit(void) {
+
+   if (AppLogRotStream) {
+      FILE *stream = AppLogRotStream;
+
+      // Late messages go to stderr
+      if (App->LogStream == stream) App->LogStream = stderr;
+      fclose(stream);
+   }
+}
+
+//! Configure log file rotation and compression
+int App_LogRotate(
+    //! [in] Segment size in bytes (0: single file)
+    const int64_t Size,
+    //! [in] Maximum number of segments kept, the first one included (0: keep all, at least 2 otherwise)
+    const int Count,
+    //! [in] Compress the segments (gzip)
+    const int Compress
+) {
+   //! \return APP_OK, APP_ERR if compression is not available
+   //! \note Must be called before the log stream is opened (first message or \ref App_LogOpen)
+
+   App->LogRotate = Size > 0 ? Size : 0;
+   App->LogRotateNb = Count > 0 ? MAX(Count, 2) : 0;
+#ifdef HAVE_ZLIB
+   App->LogCompress = Compress;
+#else
+   App->LogCompress = FALSE;
+   if (Compress) return APP_ERR;
+#endif
+   return APP_OK;
+}
+
+//! Open the log file, rotating and compressed if configured
+FILE* App_LogRotateOpen(
+    //! [in] Log file name
+    const char * const File,
+    //! [in] Open mode ("w" or "a")
+    const char * const Mode
+) {
+   //! \return Log stream, NULL on error
+   //! \note The caller must be the only writer of the file
+   TApp_LogRotate *rot;
+
+   if ((!App->LogRotate && !App->LogCompress) || AppLogRotStream) {
+      return fopen(File, Mode);
+   }
+   if (App->LogFormat == APP_LOG_BINARY) {
+      fprintf(stderr, "(WARNING) Binary log files can not be rotated or compressed, will use a single file\n");
+      return fopen(File, Mode);
+   }
+
+   if (!(rot = (TApp_LogRotate*)calloc(1, sizeof(TApp_LogRotate))) || !(rot->File = strdup(File))) {
+      free(rot);
+      return NULL;
+   }
+   rot->Eol = TRUE;
+   if (App_LogRotateSegOpen(rot, Mode) != APP_OK) {
+      free(rot->File);
+      free(rot);
+      return NULL;
+   }
+
+   cookie_io_functions_t io = { NULL, App_LogRotateWrite, NULL, App_LogRotateClose };
+   if (!(AppLogRotStream = fopencookie(rot, "w", io))) {
+      App_LogRotateClose(rot);
+      return NULL;
+   }
+   // Records are written whole (App_LogEmit), keep them whole to the callback, the segment streams are buffered
+   setvbuf(AppLogRotStream, NULL, _IONBF, 0);
+
+   static int registered = FALSE;
+   if (!registered) {
+      atexit(App_LogRotateExit);
+      registered = TRUE;
+   }
+   return AppLogRotStream;
+}
+
+//! Hold the rotation, so that consecutive records end up in the same segment
+void App_LogRotateHold(
+    //! [in] Hold (TRUE) or release (FALSE) the rotation
+    const int Hold
+) {
+   AppLogRotHold = Hold;
+}
@@ -0,0 +1,412 @@
+//! \file
+//! Intra-node shared memory log ring
+//!
+//! When enabled (APP_LOG_SHM), every rank of a node appends its complete records into a single
+//! ring buffer in a shared memory segment, reserving space atomically. A thread of the node head
+//! rank is the only one writing the ring to the log file, so other ranks do not open it at all.
+//! A record only becomes visible to the writer once completely copied; a record that stays
+//! incomplete (its rank died while writing it) is skipped after APP_LOGSHM_STALL_MS.
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/shm.h>
+
+#include "App.h"
+#include "App_Log.h"
+#include "str.h"
+
+#define APP_LOGSHM_BATCH     (1<<20)            ///< Writer batch buffer size
+#define APP_LOGSHM_WAIT_MS   1                  ///< Writer idle wait
+#define APP_LOGSHM_STALL_MS  1000               ///< Delay after which an incomplete record is considered lost
+#define APP_LOGSHM_FULL_MS   10000              ///< Delay after which a full ring is considered abandoned by its writer
+
+#define APP_ALIGN16(N) (((N)+15)&~((int64_t)15))
+
+//! Shared memory ring (header of the segment)
+typedef struct {
+   volatile int64_t Reserve;                    ///< Next free position, advanced atomically by the producers
+   int64_t          Pad0[7];
+   volatile int64_t Tail;                       ///< Position up to which the node head has consumed the ring
+   int64_t          Pad1[7];
+   int64_t          Size;                       ///< Data size (power of 2)
+   int64_t          Pad2[7];
+   char             Data[];                     ///< Records
+} TApp_LogShm;
+
+//! Record header (16 byte aligned, never wraps)
+typedef struct {
+   volatile int64_t Pos;                        ///< Position of the record once complete, ~Pos while being written
+   int64_t          Len;                        ///< Record length
+} TApp_LogShmRec;
+
+typedef enum {
+   APP_LOGSHM_OFF = 0,                          ///< Not using the shared ring
+   APP_LOGSHM_ON = 1,                           ///< Using the shared ring
+   APP_LOGSHM_DONE = 2                          ///< Writer is gone, records are appended to the file directly
+} TApp_LogShmState;
+
+#ifdef HAVE_MPI
+static TApp_LogShmState AppLogShmState = APP_LOGSHM_OFF;     ///< Ring state
+static TApp_LogShm     *AppLogShm = NULL;                    ///< Node ring
+static int              AppLogShmHead = FALSE;               ///< This rank is the node head (writer)
+static MPI_Comm         AppLogShmNode = MPI_COMM_NULL;       ///< Node communicator (rank 0 is the node head)
+static FILE            *AppLogShmStream = NULL;              ///< Stream of non head ranks, feeding the ring
+static FILE            *AppLogShmDirect = NULL;              ///< Direct stream once the writer is gone
+static pthread_t        AppLogShmWriter;                     ///< Writer thread of the node head
+static volatile int     AppLogShmWriterRun = FALSE;          ///< Writer thread is running
+static char            *AppLogShmBatch = NULL;               ///< Writer batch buffer
+static int64_t          AppLogShmLost = 0;                   ///< Number of incomplete records skipped
+
+//! Get a monotonic time in milliseconds
+static inline int64_t App_LogShmNow(void) {
+   struct timespec ts;
+#ifdef CLOCK_MONOTONIC_COARSE
+   clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+   return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+//! Copy bytes into the ring, wrapping around at the end
+static inline void App_LogShmCopyIn(TApp_LogShm *Ring, int64_t Pos, const char *Src, int64_t Len) {
+   int64_t off = Pos & (Ring->Size - 1);
+   int64_t n = MIN(Len, Ring->Size - off);
+   memcpy(Ring->Data + off, Src, n);
+   if (n < Len) memcpy(Ring->Data, Src + n, Len - n);
+}
+
+//! Copy bytes out of the ring, wrapping around at the end
+static inline void App_LogShmCopyOut(TApp_LogShm *Ring, int64_t Pos, char *Dst, int64_t Len) {
+   int64_t off = Pos & (Ring->Size - 1);
+   int64_t n = MIN(Len, Ring->Size - off);
+   memcpy(Dst, Ring->Data + off, n);
+   if (n < Len) memcpy(Dst + n, Ring->Data, Len - n);
+}
+
+//! Get the record header at a position of the ring
+static inline TApp_LogShmRec* App_LogShmRecAt(TApp_LogShm *Ring, int64_t Pos) {
+   return (TApp_LogShmRec*)(Ring->Data + (Pos & (Ring->Size - 1)));
+}
+
+//! Write a buffer to the log stream
+static void App_LogShmWrite(const char *Buf, size_t Len) {
+   pthread_mutex_lock(&App_mutex);
+   fwrite(Buf, 1, Len, App->LogStream);
+   fflush(App->LogStream);
+   pthread_mutex_unlock(&App_mutex);
+}
+
+//! Write the complete records of the ring to the log stream
+static int64_t App_LogShmDrain(
+    //! [in] Time since which the record at the tail is incomplete (updated)
+    int64_t *Stall
+) {
+   //! \return Number of bytes written
+   TApp_LogShm    *ring = AppLogShm;
+   TApp_LogShmRec *rec;
+   int64_t         tail = ring->Tail, total = 0, size = 0, pos, len;
+   int64_t         reserve = __atomic_load_n(&ring->Reserve, __ATOMIC_ACQUIRE);
+
+   while (tail < reserve) {
+      rec = App_LogShmRecAt(ring, tail);
+      pos = __atomic_load_n(&rec->Pos, __ATOMIC_ACQUIRE);
+
+      if (pos != tail) {
+         // Record is still being written, give its rank some time
+         if (!*Stall) {
+            *Stall = App_LogShmNow();
+            break;
+         }
+         if (App_LogShmNow() - *Stall < APP_LOGSHM_STALL_MS) {
+            break;
+         }
+
+         // Its rank is gone, skip it if we know its length, otherwise look for the next complete record
+         if (pos == ~tail) {
+            tail += APP_ALIGN16(sizeof(TApp_LogShmRec) + rec->Len);
+         } else {
+            for(pos = tail + 16; pos < reserve && App_LogShmRecAt(ring, pos)->Pos != pos; pos += 16);
+            if (pos >= reserve) break;
+            tail = pos;
+         }
+         AppLogShmLost++;
+         *Stall = 0;
+         __atomic_store_n(&ring->Tail, tail, __ATOMIC_RELEASE);
+         continue;
+      }
+      *Stall = 0;
+
+      len = rec->Len;
+      if (size + len > APP_LOGSHM_BATCH) {
+         App_LogShmWrite(AppLogShmBatch, size);
+         total += size;
+         size = 0;
+      }
+      App_LogShmCopyOut(ring, tail + sizeof(TApp_LogShmRec), AppLogShmBatch + size, len);
+      size += len;
+      tail += APP_ALIGN16(sizeof(TApp_LogShmRec) + len);
+
+      // Release the space as we go so producers can proceed
+      __atomic_store_n(&ring->Tail, tail, __ATOMIC_RELEASE);
+   }
+   if (size) {
+      App_LogShmWrite(AppLogShmBatch, size);
+      total += size;
+   }
+   return total;
+}
+
+//! Writer thread main loop
+static void* App_LogShmThread(void *Arg) {
+
+   struct timespec ts = { 0, APP_LOGSHM_WAIT_MS * 1000000 };
+   int64_t         stall = 0;
+
+   (void)Arg;
+   while (__atomic_load_n(&AppLogShmWriterRun, __ATOMIC_ACQUIRE)) {
+      if (!App_LogShmDrain(&stall)) {
+         nanosleep(&ts, NULL);
+      }
+   }
+   return NULL;
+}
+
+//! Stop the writer thread and write out every complete record left
+static void App_LogShmStop(void) {
+
+   int64_t stall = 0;
+
+   if (!AppLogShmWriterRun) return;
+
+   __atomic_store_n(&AppLogShmWriterRun, FALSE, __ATOMIC_RELEASE);
+   pthread_join(AppLogShmWriter, NULL);
+   App_LogShmDrain(&stall);
+
+   if (AppLogShmLost) {
+      pthread_mutex_lock(&App_mutex);
+      fprintf(App->LogStream, "(WARNING) %li incomplete log records skipped in the node shared memory ring\n", (long)AppLogShmLost);
+      fflush(App->LogStream);
+      pthread_mutex_unlock(&App_mutex);
+   }
+}
+
+//! Stream write callback of non head ranks
+static ssize_t App_LogShmStreamWrite(void *Cookie, const char *Buf, size_t Len) {
+
+   (void)Cookie;
+   if (App_LogSharedPush(Buf, Len, FALSE) == APP_OK) {
+      return Len;
+   }
+
+   // No writer to take it, append to the file like non shared ranks do
+   if (!AppLogShmDirect && !(AppLogShmDirect = fopen(App->LogFile, "a"))) {
+      return Len;
+   }
+   fwrite(Buf, 1, Len, AppLogShmDirect);
+   fflush(AppLogShmDirect);
+   return Len;
+}
+
+//! Stream close callback of non head ranks
+static int App_LogShmStreamClose(void *Cookie) {
+
+   (void)Cookie;
+   if (AppLogShmDirect) {
+      fclose(AppLogShmDirect);
+      AppLogShmDirect = NULL;
+   }
+   return 0;
+}
+#endif //HAVE_MPI
+
+//! Configure the intra-node shared memory log ring
+int App_LogShared(
+    //! [in] Ring size per node in bytes (0: every rank writes to the log file)
+    const int Size
+) {
+   //! \return Previous ring size
+   //! \note Must be called before \ref App_Start, the ring is set up collectively there
+   int ps = App->LogShared;
+
+   App->LogShared = Size > 0 ? Size : 0;
+
+   return ps;
+}
+
+//! Set up the node rings (collective on App->Comm)
+int App_LogSharedInit(void) {
+   //! \return APP_OK if using the shared ring, APP_ERR otherwise
+
+#ifdef HAVE_MPI
+   int     err, rank, shmid = -1;
+   int64_t size = 4096;
+
+   if (AppLogShmState != APP_LOGSHM_OFF || !App->LogShared || !App_IsMPI() || App->LogSplit || !App->LogFile
+      || strcmp(App->LogFile, "stdout") == 0 || strcmp(App->LogFile, "stderr") == 0) {
+      return APP_ERR;
+   }
+
+   // Ranks that already opened their stream keep writing to it directly
+   err = App->LogStream != NULL;
+   MPI_Allreduce(MPI_IN_PLACE, &err, 1, MPI_INT, MPI_MAX, App->Comm);
+   if (err) {
+      if (!App->RankMPI) {
+         fprintf(stderr, "(WARNING) Log stream already opened, shared memory log ring disabled\n");
+      }
+      return APP_ERR;
+   }
+
+   if (App->NodeComm == MPI_COMM_NULL) {
+      App_NodeGroup();
+   }
+   MPI_Comm_dup(App->NodeComm, &AppLogShmNode);
+   MPI_Comm_rank(AppLogShmNode, &rank);
+   AppLogShmHead = !rank;
+
+   // The node head creates the ring, the others attach to it
+   while (size < App->LogShared) size <<= 1;
+   if (AppLogShmHead) {
+      if ((AppLogShm = (TApp_LogShm*)shmem_allocate_shared(&shmid, sizeof(TApp_LogShm) + size))) {
+         // Start one lap in so that the zeroed segment never looks like a complete record
+         AppLogShm->Reserve = AppLogShm->Tail = size;
+         AppLogShm->Size = size;
+      } else {
+         shmid = -1;
+      }
+   }
+   MPI_Bcast(&shmid, 1, MPI_INT, 0, AppLogShmNode);
+   if (!AppLogShmHead && shmid != -1) {
+      AppLogShm = (TApp_LogShm*)shmem_address_from_id(shmid);
+      if (AppLogShm == (void*)-1) AppLogShm = NULL;
+   }
+   if (AppLogShmHead && !(AppLogShmBatch = (char*)malloc(APP_LOGSHM_BATCH))) {
+      shmid = -1;
+   }
+
+   err = !AppLogShm || shmid == -1;
+   MPI_Allreduce(MPI_IN_PLACE, &err, 1, MPI_INT, MPI_MAX, App->Comm);
+   if (err) {
+      if (!App->RankMPI) {
+         fprintf(stderr, "(WARNING) Unable to set up the shared memory log ring, every rank will write to the log file\n");
+      }
+      if (AppLogShm) shmdt(AppLogShm);
+      AppLogShm = NULL;
+      MPI_Comm_free(&AppLogShmNode);
+      return APP_ERR;
+   }
+
+   AppLogShmState = APP_LOGSHM_ON;
+   if (AppLogShmHead) {
+      // The first rank creates the file before the other heads append to it
+      if (!App->RankMPI) App_LogOpen();
+      MPI_Barrier(App->Comm);
+      if (App->RankMPI) App_LogOpen();
+
+      __atomic_store_n(&AppLogShmWriterRun, TRUE, __ATOMIC_RELEASE);
+      if (pthread_create(&AppLogShmWriter, NULL, App_LogShmThread, NULL)) {
+         // Nobody will drain the ring, records of the node ranks will be written directly when the ring fills up
+         __atomic_store_n(&AppLogShmWriterRun, FALSE, __ATOMIC_RELEASE);
+         fprintf(stderr, "(WARNING) Unable to start the shared memory log writer\n");
+      }
+   } else {
+      MPI_Barrier(App->Comm);
+
+      cookie_io_functions_t io = { NULL, App_LogShmStreamWrite, NULL, App_LogShmStreamClose };
+      AppLogShmStream = fopencookie(NULL, "w", io);
+   }
+   return APP_OK;
+#else
+   return APP_ERR;
+#endif //HAVE_MPI
+}
+
+//! Get the log stream of this rank when using the shared ring
+FILE* App_LogSharedOpen(void) {
+   //! \return Log stream, NULL if this rank has to open the log file itself
+#ifdef HAVE_MPI
+   if (AppLogShmState == APP_LOGSHM_ON && !AppLogShmHead) {
+      return AppLogShmStream;
+   }
+#endif
+   return NULL;
+}
+
+//! Append a complete record to the node ring
+int App_LogSharedPush(
+    //! [in] Record
+    const char *Rec,
+    //! [in] Record length
+    size_t Len,
+    //! [in] Wait for the record to be written out
+    const int Wait
+) {
+   //! \return APP_OK if the record was queued, APP_ERR if the caller has to write it itself
+#ifdef HAVE_MPI
+   TApp_LogShm *ring = AppLogShm;
+   int64_t      pos, need, full = 0;
+
+   if (AppLogShmState != APP_LOGSHM_ON) return APP_ERR;
+
+   need = APP_ALIGN16(sizeof(TApp_LogShmRec) + Len);
+   if (need > ring->Size / 2) return APP_ERR;
+
+   while ((pos = try_reserve_int64(&ring->Reserve, &ring->Tail, ring->Size, need)) < 0) {
+      // Do not wait forever on a writer that is not draining anymore
+      if (!full) {
+         full = App_LogShmNow();
+      } else if (App_LogShmNow() - full > APP_LOGSHM_FULL_MS) {
+         return APP_ERR;
+      }
+      sched_yield();
+   }
+
+   // Mark the record as being written, then complete it
+   TApp_LogShmRec *rec = App_LogShmRecAt(ring, pos);
+   rec->Len = Len;
+   __atomic_store_n(&rec->Pos, ~pos, __ATOMIC_RELEASE);
+   App_LogShmCopyIn(ring, pos + sizeof(TApp_LogShmRec), Rec, Len);
+   __atomic_store_n(&rec->Pos, pos, __ATOMIC_RELEASE);
+
+   if (Wait) {
+      struct timespec ts = { 0, 100000 };
+      int64_t         start = App_LogShmNow();
+      while (__atomic_load_n(&ring->Tail, __ATOMIC_ACQUIRE) <= pos && App_LogShmNow() - start < APP_LOGSHM_STALL_MS) {
+         nanosleep(&ts, NULL);
+      }
+   }
+   return APP_OK;
+#else
+   (void)Rec; (void)Len; (void)Wait;
+   return APP_ERR;
+#endif
+}
+
+//! Stop using the node ring and write out what is left
+void App_LogSharedEnd(
+    //! [in] Called by every rank of App->Comm, the node heads wait for their node's ranks
+    const int Collective
+) {
+#ifdef HAVE_MPI
+   if (AppLogShmState != APP_LOGSHM_ON) return;
+
+   if (Collective) {
+      // Every rank of the node is done writing into the ring
+      MPI_Barrier(AppLogShmNode);
+      MPI_Comm_free(&AppLogShmNode);
+   }
+   if (AppLogShmHead) {
+      App_LogShmStop();
+   } else {
+      pthread_mutex_lock(&App_mutex);
+      if (AppLogShmStream) fflush(AppLogShmStream);
+      pthread_mutex_unlock(&App_mutex);
+   }
+   AppLogShmState = APP_LOGSHM_DONE;
+#else
+   (void)Collective;
+#endif
+}
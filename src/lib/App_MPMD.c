@@ -443,10 +443,11 @@ int32_t App_MPMD_Init() {
         App_Log(APP_DEBUG, "%s: PE %06d app->SelfComponent->comm != MPI_COMM_NULL = %d\n", __func__,
             app->WorldRank, app->SelfComponent->comm != MPI_COMM_NULL);
 
-        if (app->ComponentRank == 0) {
+        if (app->ComponentRank == 0 && app->LogRank != APP_LOGRANK_SET) {
             // Declare that rank 0 of this component is "active" as a logger
             App_LogRank(app->WorldRank);
         }
+        App_LogRankSelect();
 
         if (app->WorldRank == 0 && app->ComponentRank != 0) {
             //! \todo Remove this? How would it even be possible?
@@ -1,12 +1,165 @@
+#include <string.h>
+#include <math.h>
+
+#include "App.h"
 #include "App_Timer.h"
+#ifdef APP_TIMER_HAVE_TSC
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+TApp_TimerTSC AppTimerTSC = { FALSE, 0, 0, 0 };
+
+//! Select the clock of the timers, calibrating the time stamp counter
+int App_TimerClock(
+    //! [in] Clock (TSC: invariant time stamp counter, MONOTONIC: clock_gettime)
+    const char * const Clock
+) {
+    //! \return APP_OK, APP_ERR if the clock is unknown or the time stamp counter is not invariant (clock_gettime kept)
+    //! \note Called by \ref App_Start with APP_TIMER_CLOCK, timers running while the clock changes are off by the calibration error
+    if (strcasecmp(Clock, "MONOTONIC") == 0) {
+        AppTimerTSC.On = FALSE;
+        return APP_OK;
+    }
+    if (strcasecmp(Clock, "TSC") != 0) return APP_ERR;
+
+#ifdef APP_TIMER_HAVE_TSC
+    unsigned int eax, ebx, ecx, edx, aux;
+    struct timespec t0, t1, mono, wait = { 0, 5000000 };
+    uint64_t tick0, tick1, tick;
+
+    // Invariant TSC (constant rate, running in deep C-states) and RDTSCP
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1 << 8))) return APP_ERR;
+    if (!__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) || !(edx & (1 << 27))) return APP_ERR;
+
+    // Rate against the raw clock (not slewed by NTP), over a few milliseconds
+    tick0 = __rdtscp(&aux);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &t0);
+    tick0 = (tick0 + __rdtscp(&aux)) / 2;
+    nanosleep(&wait, NULL);
+    tick1 = __rdtscp(&aux);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &t1);
+    tick1 = (tick1 + __rdtscp(&aux)) / 2;
+
+    uint64_t ns = (uint64_t)(t1.tv_sec - t0.tv_sec) * 1000000000 + t1.tv_nsec - t0.tv_nsec;
+    if (tick1 <= tick0 || !ns) return APP_ERR;
+
+    // Anchored on APP_CLOCK_ID so that both clocks give the same times
+    tick = __rdtscp(&aux);
+    clock_gettime(APP_CLOCK_ID, &mono);
+    tick = (tick + __rdtscp(&aux)) / 2;
+
+    AppTimerTSC.On = FALSE;
+    AppTimerTSC.Mult = (uint64_t)(((unsigned __int128)ns << 32) / (tick1 - tick0));
+    AppTimerTSC.Tick0 = tick;
+    AppTimerTSC.Time0 = (uint64_t)mono.tv_sec * 1000000000 + mono.tv_nsec;
+    AppTimerTSC.On = TRUE;
+
+    return APP_OK;
+#else
+    return APP_ERR;
+#endif
+}
+
+//! Keep a histogram of the intervals of a timer
+int App_TimerHisto(
+    //! [in] Timer
+    TApp_Timer * const Timer
+) {
+    //! \return APP_OK, APP_ERR if the histogram cannot be allocated
+    //! \note The histogram is freed by \ref App_TimerDelete, detached (not freed) by \ref App_TimerInit, and cleared by the Fortran create
+    if (!Timer->Histo && !(Timer->Histo = (TApp_TimerHisto*)calloc(1, sizeof(TApp_TimerHisto)))) return APP_ERR;
+
+    return APP_OK;
+}
+
+//! Get a percentile of the intervals of a histogram
+double App_TimerHistoPercentile(
+    //! [in] Histogram
+    const TApp_TimerHisto * const Histo,
+    //! [in] Percentile (0-100, 100 gives the maximum)
+    const double Percent
+) {
+    //! \return Middle of the bucket holding the percentile (ns), within 1/32 of the interval, 0 if empty
+    uint64_t rank, nb = 0;
+
+    if (!Histo || !Histo->Nb) return 0.0;
+    if (Percent >= 100.0) return Histo->Max;
+
+    rank = (uint64_t)ceil(Percent / 100.0 * Histo->Nb);
+    if (!rank) rank = 1;
+
+    for(int idx = 0; idx < APP_TIMERHISTO_NB; idx++) {
+        if ((nb += Histo->Count[idx]) < rank) continue;
+        if (idx < APP_TIMERHISTO_SUB) return idx;
+
+        // Bucket of [(16 + sub) << (e - 4), (17 + sub) << (e - 4)[
+        int    e = idx / APP_TIMERHISTO_SUB + 3;
+        double low = (double)((uint64_t)(APP_TIMERHISTO_SUB + idx % APP_TIMERHISTO_SUB) << (e - 4));
+        double mid = low + (double)((uint64_t)1 << (e - 4)) / 2.0;
+
+        return mid < Histo->Max ? mid : Histo->Max;
+    }
+    return Histo->Max;
+}
+
+//! Get a percentile of the intervals of a timer in milliseconds
+double App_TimerPercentile_ms(
+    //! [in] Timer with a histogram (see \ref App_TimerHisto)
+    const TApp_Timer * const Timer,
+    //! [in] Percentile (0-100)
+    const double Percent
+) {
+    //! \return Percentile of the intervals (ms), 0 without histogram
+    return App_TimerHistoPercentile(Timer->Histo, Percent) / 1e6;
+}
+
+//! Merge the histograms of a timer over all the ranks on rank 0 (collective on App->Comm)
+int App_TimerHistoReduce(
+    //! [in,out] Timer with a histogram on all the ranks, merged on rank 0
+    TApp_Timer * const Timer
+) {
+    //! \return APP_OK, APP_ERR if the timer has no histogram
+    if (!Timer->Histo) return APP_ERR;
+
+#ifdef HAVE_MPI
+    if (App_IsMPI()) {
+        TApp_TimerHisto *histo = Timer->Histo;
+
+        // Counts are summed and maxima compared
+        if (!App->RankMPI) {
+            MPI_Reduce(MPI_IN_PLACE, histo->Count, APP_TIMERHISTO_NB, MPI_UINT64_T, MPI_SUM, 0, App->Comm);
+            MPI_Reduce(MPI_IN_PLACE, &histo->Nb, 1, MPI_UINT64_T, MPI_SUM, 0, App->Comm);
+            MPI_Reduce(MPI_IN_PLACE, &histo->Max, 1, MPI_UINT64_T, MPI_MAX, 0, App->Comm);
+        } else {
+            MPI_Reduce(histo->Count, NULL, APP_TIMERHISTO_NB, MPI_UINT64_T, MPI_SUM, 0, App->Comm);
+            MPI_Reduce(&histo->Nb, NULL, 1, MPI_UINT64_T, MPI_SUM, 0, App->Comm);
+            MPI_Reduce(&histo->Max, NULL, 1, MPI_UINT64_T, MPI_MAX, 0, App->Comm);
+        }
+    }
+#endif
+    return APP_OK;
+}
+
+//! Reset a timer from Fortran (timer % create on an existing timer), keeping its histogram cleared
+void App_TimerInit_f(TApp_Timer* Timer) {
+    TApp_TimerHisto *histo = Timer ? Timer->Histo : NULL;
+
+    App_TimerInit(Timer);
+    if (histo) {
+        memset(histo, 0, sizeof(TApp_TimerHisto));
+        Timer->Histo = histo;
+    }
+}
 
-void App_TimerInit_f(TApp_Timer* Timer) { App_TimerInit(Timer); }
 TApp_Timer* App_TimerCreate_f() { return App_TimerCreate(); }
 void App_TimerDelete_f(TApp_Timer* Timer) { App_TimerDelete(Timer); }
 void App_TimerStart_f(TApp_Timer* Timer) { App_TimerStart(Timer); }
 void App_TimerStop_f(TApp_Timer* Timer) { App_TimerStop(Timer); }
 double App_TimerTotalTime_ms_f(const TApp_Timer* Timer) { return App_TimerTotalTime_ms(Timer); }
 double App_TimerLatestTime_ms_f(const TApp_Timer* Timer) { return App_TimerLatestTime_ms(Timer); }
+int App_TimerHisto_f(TApp_Timer* Timer) { return App_TimerHisto(Timer); }
+double App_TimerPercentile_ms_f(const TApp_Timer* Timer, const double Percent) { return App_TimerPercentile_ms(Timer, Percent); }
 double App_TimerTimeSinceStart_ms_f(const TApp_Timer* Timer) { return App_TimerTimeSinceStart_ms(Timer); }
 
 void sleep_us_f(const int num_us) { sleep_us(num_us); }
@@ -4,37 +4,98 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <time.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#define APP_TIMER_HAVE_TSC
+#endif
 
 #define APP_LATEST 0
 #define APP_TOTAL 1
 
-//! Timer that can accumulate microsecond intervals
+#define APP_TIMERHISTO_SUB 16   //! Sub-buckets per power of 2 (relative resolution of 1/16)
+#define APP_TIMERHISTO_NB  720  //! Number of buckets, exact below 16 ns, up to 2^48 ns (about 78 hours)
+
+//! Log bucketed histogram of intervals (HDR style)
+typedef struct {
+  uint64_t Nb;                          //! Number of intervals
+  uint64_t Max;                         //! Longest interval (ns)
+  uint64_t Count[APP_TIMERHISTO_NB];    //! Number of intervals per bucket
+} TApp_TimerHisto;
+
+//! Timer that can accumulate nanosecond intervals
+//! \note The fields were Start, LatestTime and TotalTime in microseconds, use the _ms accessors rather than the fields
 typedef struct {
-  uint64_t Start;      //! Timestamp when the timer was started
-  uint64_t LatestTime; //! Number of ticks between latest start/stop cycle
-  uint64_t TotalTime;  //! How many clock ticks have been recorded (updates every time the timer stops)
+  uint64_t StartNs;      //! Timestamp when the timer was started (ns)
+  uint64_t LatestTimeNs; //! Number of nanoseconds between latest start/stop cycle
+  uint64_t TotalTimeNs;  //! How many nanoseconds have been recorded (updates every time the timer stops)
   char     String[32]; //! Output representation
+  const char *Name;    //! Name of the timer in the event traces (NULL: not traced)
+  TApp_TimerHisto *Histo; //! Histogram of the intervals (NULL: none), see App_TimerHisto
 } TApp_Timer;
 
+//! Time stamp counter clock, calibrated by App_TimerClock
+typedef struct {
+  int      On;         //! Time stamp counter used instead of clock_gettime
+  uint64_t Tick0;      //! Counter at calibration
+  uint64_t Time0;      //! Time at calibration (ns, APP_CLOCK_ID)
+  uint64_t Mult;       //! Nanoseconds per tick (32.32 fixed point)
+} TApp_TimerTSC;
+
+extern volatile int AppTimerTrace;   //! Event tracing is on, see App_TimerTrace
+extern TApp_TimerTSC AppTimerTSC;   //! Time stamp counter clock
+
 static const clockid_t APP_CLOCK_ID = CLOCK_MONOTONIC;
 
+int App_TimerClock(const char * const Clock);
+int App_TimerHisto(TApp_Timer * const Timer);
+int App_TimerHistoReduce(TApp_Timer * const Timer);
+double App_TimerHistoPercentile(const TApp_TimerHisto * const Histo, const double Percent);
+double App_TimerPercentile_ms(const TApp_Timer * const Timer, const double Percent);
+
 //! Values that correspond to a reset timer
 #define NULL_TIMER ((const TApp_Timer) {     \
-  .Start = 0,                                \
-  .LatestTime = 0,                           \
-  .TotalTime = 0                             \
+  .StartNs = 0,                              \
+  .LatestTimeNs = 0,                         \
+  .TotalTimeNs = 0                           \
 })
 
-//! Get current system time in microseconds, wraps around approximately every year
-static inline uint64_t get_current_time_us() {
+//! Get current system time in nanoseconds, from the time stamp counter if calibrated (see App_TimerClock)
+static inline uint64_t get_current_time_ns() {
 
+#ifdef APP_TIMER_HAVE_TSC
+  if (AppTimerTSC.On) {
+    unsigned int aux;
+    // 64 bit counter and 128 bit product, no wraparound
+    return(AppTimerTSC.Time0 + (uint64_t)(((unsigned __int128)(__builtin_ia32_rdtscp(&aux) - AppTimerTSC.Tick0) * AppTimerTSC.Mult) >> 32));
+  }
+#endif
   struct timespec now;
   clock_gettime(APP_CLOCK_ID, &now);
 
-  // Wraps around every year or so. Not sure why you would need microsecond precision for longer
-  const uint64_t now_us = ((uint64_t)now.tv_sec % (1 << 25)) * 1000000 + (uint64_t)now.tv_nsec / 1000;
+  return((uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec);
+}
 
-  return(now_us);
+//! Get current system time in microseconds
+static inline uint64_t get_current_time_us() {
+  return(get_current_time_ns() / 1000);
+}
+
+//! Get the histogram bucket of an interval
+static inline int App_TimerHistoIndex(const uint64_t Time) {
+
+  if (Time < APP_TIMERHISTO_SUB) return((int)Time);
+
+  // Power of 2 and the 4 bits below the leading one
+  const int e = 63 - __builtin_clzll(Time);
+  const int idx = (e - 3) * APP_TIMERHISTO_SUB + (int)((Time >> (e - 4)) & (APP_TIMERHISTO_SUB - 1));
+
+  return(idx < APP_TIMERHISTO_NB ? idx : APP_TIMERHISTO_NB - 1);
+}
+
+//! Add an interval to a histogram (not thread safe)
+static inline void App_TimerHistoAdd(TApp_TimerHisto* Histo, const uint64_t Time) {
+  Histo->Count[App_TimerHistoIndex(Time)]++;
+  Histo->Nb++;
+  if (Time > Histo->Max) Histo->Max = Time;
 }
 
 static inline void App_TimerInit(TApp_Timer* Timer) {
@@ -49,38 +110,57 @@ static inline TApp_Timer* App_TimerCreate() {
 }
 
 static inline void App_TimerDelete(TApp_Timer* Timer) {
-   if (Timer != NULL) free(Timer);
+   if (Timer != NULL) {
+      free(Timer->Histo);
+      free(Timer);
+   }
 }
 
+void App_TimerTraceTimer(const TApp_Timer * const Timer);
+
 //! Record the current timestamp
 static inline void App_TimerStart(TApp_Timer* Timer) {
-   Timer->Start = get_current_time_us();
+   Timer->StartNs = get_current_time_ns();
 }
 
 //! Increment total time with number of ticks since last start
 static inline void App_TimerStop(TApp_Timer* Timer) {
-   Timer->LatestTime = get_current_time_us() - Timer->Start;
-   Timer->TotalTime += Timer->LatestTime;
+   Timer->LatestTimeNs = get_current_time_ns() - Timer->StartNs;
+   Timer->TotalTimeNs += Timer->LatestTimeNs;
+   if (Timer->Histo) App_TimerHistoAdd(Timer->Histo, Timer->LatestTimeNs);
+   if (AppTimerTrace && Timer->Name) App_TimerTraceTimer(Timer);
 }
 
 //! Retrieve the accumulated time in number of milliseconds, as a double
 static inline double App_TimerTotalTime_ms(const TApp_Timer* Timer) {
-   // If we only count microseconds in a year, this conversion to double does not lose any precision (about 2^31 us/year)
-   return(Timer->TotalTime / 1000.0);
+   // Exact up to 2^53 ns (about 104 days), then relative precision of 1e-16
+   return(Timer->TotalTimeNs / 1e6);
 }
 
 //! Retrieve the time between the latest start/stop cycle in number of milliseconds, as a double
 static inline double App_TimerLatestTime_ms(const TApp_Timer* Timer) {
-  // If we only count microseconds in a year, this conversion to double does not lose any precision (about 2^31 us/year)
-  return Timer->LatestTime / 1000.0;
+  return Timer->LatestTimeNs / 1e6;
 }
 
 //! Compute the time between "right now" and the point when this timer was last started
 static inline double App_TimerTimeSinceStart_ms(const TApp_Timer* Timer) {
-   // If we only count microseconds in a year, this conversion to double does not lose any precision (about 2^31 us/year)
-   return((get_current_time_us() - Timer->Start) / 1000.0);
+   return((get_current_time_ns() - Timer->StartNs) / 1e6);
 }
 
+//! Named timer regions, see App_TimerRegion.c
+int  App_TimerRegionBegin(const char * const Name);
+int  App_TimerRegionEnd(const char * const Name);
+int  App_TimerRegionBeginN(const char * const Name, const int Len);
+int  App_TimerRegionEndN(const char * const Name, const int Len);
+void App_TimerRegionReport(void);
+int  App_TimerRegionReduce(void);
+void App_TimerRegionStatReport(void);
+void App_TimerRegionStats(void);
+int  App_TimerRegionHisto(const int On);
+int  App_TimerTrace(const char * const Path, const int Events, const char * const Steps);
+void App_TimerTraceAdd(const char * const Name, const int Len, const uint64_t Start, const uint64_t Duration);
+void App_TimerTraceWrite(const int Collective);
+
 static inline void sleep_us(
     const int num_us //!< [in] How many microseconds we want to wait
 ) {
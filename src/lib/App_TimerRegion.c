@@ -0,0 +1,435 @@
+//! \file
+//! Hierarchical named timer regions
+//!
+//! Regions are delimited by \ref App_TimerRegionBegin and \ref App_TimerRegionEnd, and nest dynamically: the same name
+//! begun within different regions makes different nodes of the call tree. Each thread keeps its own stack of open
+//! regions, regions begun by a thread outside of any region of its own being roots. Nodes live in a preallocated table
+//! indexed by a hash of their name and parent, claimed lock free, so that a begin/end pair costs two clock reads and
+//! a few atomic additions. The call tree, with inclusive and exclusive times and call counts, is printed in the
+//! \ref App_End footer or on demand with \ref App_TimerRegionReport.
+//!
+//! With MPI, the inclusive times of the regions are also reduced over App->Comm (\ref App_TimerRegionReduce) into
+//! min/max with their rank, mean, standard deviation and imbalance (max/mean) per region. Regions are matched by
+//! the key of their path, each rank contributing a table sorted by key which a custom MPI_Op merges, so that ranks
+//! with different regions reduce correctly with a constant size per region whatever the number of ranks.
+//!
+//! With histograms (APP_TIMER_HISTO or \ref App_TimerRegionHisto, the same on all ranks), the duration of every call
+//! is also counted in a log bucketed histogram per region, giving the p50/p90/p99/max of the calls of each region,
+//! of this rank in the call tree and of all the ranks, the histograms being merged by the reduction, in the statistics.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "App.h"
+#include "str.h"
+
+#define APP_TIMERREGION_MAX   1024              ///< Maximum number of nodes of the call tree (power of 2)
+#define APP_TIMERREGION_DEPTH 64                ///< Maximum nesting depth of the regions of a thread
+#define APP_TIMERREGION_NAME  64                ///< Maximum length of a region name
+
+//! Node of the region call tree
+typedef struct {
+   volatile uint64_t Key;                       ///< Node key, hash of the name and parent (0: free slot)
+   volatile int      Ready;                     ///< Node description is set
+   int               Parent;                    ///< Parent node (-1: root)
+   int               Depth;                     ///< Depth in the call tree
+   char              Name[APP_TIMERREGION_NAME];///< Region name
+   volatile uint64_t Calls;                     ///< Number of calls
+   volatile uint64_t Total;                     ///< Inclusive time (ns)
+   volatile uint64_t Child;                     ///< Inclusive time of the child regions (ns)
+   TApp_TimerHisto * volatile Histo;            ///< Histogram of the call durations (NULL: none yet)
+} TApp_TimerRegion;
+
+//! Open region of a thread
+typedef struct {
+   int      Node;                               ///< Node of the region (-1: table full)
+   uint64_t Start;                              ///< Begin time (ns)
+} TApp_TimerRegionOpen;
+
+static TApp_TimerRegion AppTimerRegions[APP_TIMERREGION_MAX];   ///< Nodes of the call tree
+static int              AppTimerRegionOrder[APP_TIMERREGION_MAX];   ///< Nodes in creation order
+static volatile int     AppTimerRegionNb = 0;                   ///< Number of nodes
+
+//! Cross-rank statistics of a region
+typedef struct {
+   uint64_t Key;                                ///< Node key (0: unused entry, sorted last)
+   uint64_t Parent;                             ///< Parent node key (0: root)
+   int      Depth;                              ///< Depth in the call tree
+   int      Nb;                                 ///< Number of ranks with the region
+   int      MinRank, MaxRank;                   ///< Ranks of the minimum and maximum
+   double   Min, Max;                           ///< Minimum and maximum inclusive time (ms)
+   double   Sum, Sum2;                          ///< Sum and sum of squares of the inclusive time (ms)
+   char     Name[APP_TIMERREGION_NAME];         ///< Region name
+   TApp_TimerHisto Histo[];                     ///< Merged histogram of the call durations, with histograms only
+} TApp_TimerRegionStat;
+
+//! Statistics entry of a table, entries being followed by a histogram or not
+#define APP_TIMERREGION_STAT(Stats, N) ((TApp_TimerRegionStat*)((char*)(Stats) + (size_t)(N) * AppTimerRegionStatSize))
+
+static TApp_TimerRegionStat *AppTimerRegionStats = NULL;      ///< Reduced statistics, on rank 0
+static int                   AppTimerRegionStatNb = 0;        ///< Number of reduced statistics
+static size_t                AppTimerRegionStatSize = sizeof(TApp_TimerRegionStat);   ///< Size of a statistics entry
+static int                   AppTimerRegionHistoOn = FALSE;   ///< Keep histograms of the call durations
+
+static __thread TApp_TimerRegionOpen AppTimerRegionStack[APP_TIMERREGION_DEPTH];   ///< Open regions of the thread
+static __thread int                  AppTimerRegionDepth = 0;                      ///< Number of open regions of the thread
+
+//! Find the node of a region, claiming a free one for a new region
+static int App_TimerRegionFind(
+   //! [in] Region name
+   const char * const Name,
+   //! [in] Length of the name
+   const int Len,
+   //! [in] Parent node (-1: root)
+   const int Parent
+) {
+   //! \return Node index, -1 if the table is full
+   uint64_t key = 0xCBF29CE484222325ULL, k;
+   int      len = MIN(Len, APP_TIMERREGION_NAME - 1);
+
+   // FNV-1a of the name, mixed with the key of the parent so that a path has the same key on all ranks, 0 marks a free slot
+   for(int c = 0; c < len; c++) key = (key ^ (unsigned char)Name[c]) * 0x100000001B3ULL;
+   key ^= (Parent < 0 ? 0 : AppTimerRegions[Parent].Key) * 0x9E3779B97F4A7C15ULL;
+   key ^= key >> 33; key *= 0xFF51AFD7ED558CCDULL;
+   key ^= key >> 33;
+   if (!key) key = 1;
+
+   for(int n = 0; n < APP_TIMERREGION_MAX; n++) {
+      int               idx = (key + n) & (APP_TIMERREGION_MAX - 1);
+      TApp_TimerRegion *node = &AppTimerRegions[idx];
+
+      k = __atomic_load_n(&node->Key, __ATOMIC_ACQUIRE);
+      if (!k) {
+         if (__sync_bool_compare_and_swap(&node->Key, 0, key)) {
+            memcpy(node->Name, Name, len);
+            node->Name[len] = '\0';
+            node->Parent = Parent;
+            node->Depth = Parent < 0 ? 0 : AppTimerRegions[Parent].Depth + 1;
+            AppTimerRegionOrder[__sync_fetch_and_add(&AppTimerRegionNb, 1)] = idx;
+            __atomic_store_n(&node->Ready, TRUE, __ATOMIC_RELEASE);
+            return idx;
+         }
+         k = __atomic_load_n(&node->Key, __ATOMIC_ACQUIRE);
+      }
+      if (k == key) return idx;
+   }
+   return -1;
+}
+
+//! Count a call duration in the histogram of a region
+static void App_TimerRegionHistoAdd(
+   //! [in] Node of the region
+   TApp_TimerRegion * const Node,
+   //! [in] Duration of the call (ns)
+   const uint64_t Time
+) {
+   TApp_TimerHisto *histo = __atomic_load_n(&Node->Histo, __ATOMIC_ACQUIRE);
+   uint64_t         max;
+
+   // First call with histograms, only one thread gets its histogram in
+   if (!histo) {
+      if (!(histo = (TApp_TimerHisto*)calloc(1, sizeof(TApp_TimerHisto)))) return;
+      if (!__sync_bool_compare_and_swap(&Node->Histo, NULL, histo)) {
+         free(histo);
+         histo = __atomic_load_n(&Node->Histo, __ATOMIC_ACQUIRE);
+      }
+   }
+   __sync_fetch_and_add(&histo->Count[App_TimerHistoIndex(Time)], 1);
+   __sync_fetch_and_add(&histo->Nb, 1);
+   while (Time > (max = __atomic_load_n(&histo->Max, __ATOMIC_RELAXED)) && !__sync_bool_compare_and_swap(&histo->Max, max, Time));
+}
+
+//! Keep histograms of the call durations of the regions
+int App_TimerRegionHisto(
+   //! [in] Keep the histograms (FALSE: stop counting, the histograms being kept)
+   const int On
+) {
+   //! \return Previous mode
+   //! \note Has to be the same on all the ranks for the cross-rank statistics
+   int po = AppTimerRegionHistoOn;
+
+   AppTimerRegionHistoOn = On;
+   AppTimerRegionStatSize = sizeof(TApp_TimerRegionStat) + (On ? sizeof(TApp_TimerHisto) : 0);
+
+   return po;
+}
+
+//! Begin a named region of the calling thread (Length given)
+int App_TimerRegionBeginN(
+   //! [in] Region name (not necessarily null terminated)
+   const char * const Name,
+   //! [in] Length of the name
+   const int Len
+) {
+   //! \return APP_OK, APP_ERR if the regions are nested too deep
+   int depth = AppTimerRegionDepth++;
+
+   if (depth >= APP_TIMERREGION_DEPTH) return APP_ERR;
+
+   AppTimerRegionStack[depth].Node = App_TimerRegionFind(Name, Len, depth ? AppTimerRegionStack[depth - 1].Node : -1);
+   AppTimerRegionStack[depth].Start = get_current_time_ns();
+
+   return APP_OK;
+}
+
+//! End the innermost region of the calling thread (Length given)
+int App_TimerRegionEndN(
+   //! [in] Region name, checked against the innermost region (NULL: not checked)
+   const char * const Name,
+   //! [in] Length of the name
+   const int Len
+) {
+   //! \return APP_OK, APP_ERR if no region is open or the name does not match
+   uint64_t          end = get_current_time_ns();
+   int               depth, len;
+   TApp_TimerRegion *node;
+
+   if (AppTimerRegionDepth <= 0) {
+      App_Log(APP_WARNING, "%s: No timer region to end (%.*s)\n", __func__, Name ? Len : 0, Name ? Name : "");
+      return APP_ERR;
+   }
+
+   depth = --AppTimerRegionDepth;
+   if (depth >= APP_TIMERREGION_DEPTH || AppTimerRegionStack[depth].Node < 0) return APP_OK;
+
+   node = &AppTimerRegions[AppTimerRegionStack[depth].Node];
+   end -= AppTimerRegionStack[depth].Start;
+   __sync_fetch_and_add(&node->Calls, 1);
+   __sync_fetch_and_add(&node->Total, end);
+   if (node->Parent >= 0) __sync_fetch_and_add(&AppTimerRegions[node->Parent].Child, end);
+   if (AppTimerRegionHistoOn) App_TimerRegionHistoAdd(node, end);
+   if (AppTimerTrace) App_TimerTraceAdd(node->Name, strlen(node->Name), AppTimerRegionStack[depth].Start, end);
+
+   // Names are kept truncated
+   len = MIN(Len, APP_TIMERREGION_NAME - 1);
+   if (Name && (len != (int)strlen(node->Name) || strncmp(Name, node->Name, len))) {
+      App_Log(APP_WARNING, "%s: Ending timer region %.*s while in %s\n", __func__, Len, Name, node->Name);
+      return APP_ERR;
+   }
+   return APP_OK;
+}
+
+//! Begin a named region of the calling thread
+int App_TimerRegionBegin(
+   //! [in] Region name
+   const char * const Name
+) {
+   //! \return APP_OK, APP_ERR if the regions are nested too deep
+   return App_TimerRegionBeginN(Name, strlen(Name));
+}
+
+//! End the innermost region of the calling thread
+int App_TimerRegionEnd(
+   //! [in] Region name, checked against the innermost region (NULL: not checked)
+   const char * const Name
+) {
+   //! \return APP_OK, APP_ERR if no region is open or the name does not match
+   return App_TimerRegionEndN(Name, Name ? strlen(Name) : 0);
+}
+
+//! Print the nodes of a sub tree
+static void App_TimerRegionPrint(
+   //! [in] Parent node of the sub tree (-1: roots)
+   const int Parent
+) {
+   int nb = __atomic_load_n(&AppTimerRegionNb, __ATOMIC_ACQUIRE);
+
+   for(int n = 0; n < nb; n++) {
+      int               idx = AppTimerRegionOrder[n];
+      TApp_TimerRegion *node = &AppTimerRegions[idx];
+
+      if (!__atomic_load_n(&node->Ready, __ATOMIC_ACQUIRE) || node->Parent != Parent) continue;
+
+      // Children of parallel threads can outlast their parent
+      uint64_t excl = node->Total > node->Child ? node->Total - node->Child : 0;
+
+      if (AppTimerRegionHistoOn) {
+         TApp_TimerHisto *histo = node->Histo;
+         App_Log(APP_VERBATIM, "                 %*s%-*s %10lu %12.3f %12.3f %10.3f %10.3f %10.3f %10.3f\n", node->Depth * 2, "", 30 - node->Depth * 2, node->Name,
+            (unsigned long)node->Calls, node->Total / 1e6, excl / 1e6, App_TimerHistoPercentile(histo, 50) / 1e6, App_TimerHistoPercentile(histo, 90) / 1e6,
+            App_TimerHistoPercentile(histo, 99) / 1e6, App_TimerHistoPercentile(histo, 100) / 1e6);
+      } else {
+         App_Log(APP_VERBATIM, "                 %*s%-*s %10lu %12.3f %12.3f\n", node->Depth * 2, "", 30 - node->Depth * 2, node->Name,
+            (unsigned long)node->Calls, node->Total / 1e6, excl / 1e6);
+      }
+      App_TimerRegionPrint(idx);
+   }
+}
+
+//! Log the call tree of the timer regions
+void App_TimerRegionReport(void) {
+
+   //! \note Called by \ref App_End, open regions are not accounted for
+   if (!__atomic_load_n(&AppTimerRegionNb, __ATOMIC_ACQUIRE)) return;
+
+   App_Log(APP_VERBATIM, "Timer regions  : %-30s %10s %12s %12s%s\n", "region", "calls", "incl(ms)", "excl(ms)",
+      AppTimerRegionHistoOn ? "    p50(ms)    p90(ms)    p99(ms)  worst(ms)" : "");
+   App_TimerRegionPrint(-1);
+}
+
+#ifdef HAVE_MPI
+//! Order statistics by key, unused entries last
+static int App_TimerRegionStatCompare(const void *A, const void *B) {
+   uint64_t a = ((const TApp_TimerRegionStat*)A)->Key - 1, b = ((const TApp_TimerRegionStat*)B)->Key - 1;
+
+   return a < b ? -1 : a > b;
+}
+
+//! Merge two tables of statistics sorted by key (MPI_Op, one element is a whole table)
+static void App_TimerRegionStatMerge(void *In, void *InOut, int *Len, MPI_Datatype *Type) {
+   TApp_TimerRegionStat *in, *io, *o;
+   char                 *out;
+   int                   size, nb, i, j, n;
+
+   MPI_Type_size(*Type, &size);
+   nb = size / AppTimerRegionStatSize;
+   if (!(out = (char*)calloc(nb, AppTimerRegionStatSize))) return;
+
+   for(int l = 0; l < *Len; l++, In = (char*)In + size, InOut = (char*)InOut + size) {
+      i = j = n = 0;
+      while (n < nb) {
+         in = i < nb ? APP_TIMERREGION_STAT(In, i) : NULL;
+         io = j < nb ? APP_TIMERREGION_STAT(InOut, j) : NULL;
+         if (in && !in->Key) in = NULL;
+         if (io && !io->Key) io = NULL;
+         if (!in && !io) break;
+
+         o = APP_TIMERREGION_STAT(out, n++);
+         if (!io || (in && in->Key - 1 < io->Key - 1)) {
+            memcpy(o, in, AppTimerRegionStatSize);
+            i++;
+         } else if (!in || io->Key - 1 < in->Key - 1) {
+            memcpy(o, io, AppTimerRegionStatSize);
+            j++;
+         } else {
+            // Same region on both sides
+            memcpy(o, io, AppTimerRegionStatSize);
+            o->Nb += in->Nb;
+            o->Sum += in->Sum;
+            o->Sum2 += in->Sum2;
+            if (in->Min < o->Min || (in->Min == o->Min && in->MinRank < o->MinRank)) {
+               o->Min = in->Min;
+               o->MinRank = in->MinRank;
+            }
+            if (in->Max > o->Max || (in->Max == o->Max && in->MaxRank < o->MaxRank)) {
+               o->Max = in->Max;
+               o->MaxRank = in->MaxRank;
+            }
+            if (AppTimerRegionHistoOn) {
+               for(int b = 0; b < APP_TIMERHISTO_NB; b++) o->Histo->Count[b] += in->Histo->Count[b];
+               o->Histo->Nb += in->Histo->Nb;
+               o->Histo->Max = MAX(o->Histo->Max, in->Histo->Max);
+            }
+            i++; j++;
+         }
+      }
+      memcpy(InOut, out, (size_t)n * AppTimerRegionStatSize);
+      memset((char*)InOut + (size_t)n * AppTimerRegionStatSize, 0, (size_t)(nb - n) * AppTimerRegionStatSize);
+   }
+   free(out);
+}
+#endif
+
+//! Reduce the inclusive times of the regions over all the ranks on rank 0 (collective on App->Comm)
+int App_TimerRegionReduce(void) {
+
+   //! \return Number of regions reduced (on rank 0), 0 without MPI
+   //! \note When the ranks have more than APP_TIMERREGION_MAX distinct regions, the ones with the largest keys are dropped
+#ifdef HAVE_MPI
+   TApp_TimerRegionStat *stats;
+   MPI_Datatype          type;
+   MPI_Op                op;
+   int                   nb, all;
+
+   if (!App_IsMPI()) return 0;
+
+   // Size of the union of the regions
+   nb = __atomic_load_n(&AppTimerRegionNb, __ATOMIC_ACQUIRE);
+   MPI_Allreduce(&nb, &all, 1, MPI_INT, MPI_SUM, App->Comm);
+   if (!(all = MIN(all, APP_TIMERREGION_MAX))) return 0;
+
+   if (!(stats = (TApp_TimerRegionStat*)calloc(all, AppTimerRegionStatSize))) {
+      App_Log(APP_ERROR, "%s: Unable to allocate statistics buffer\n", __func__);
+      MPI_Abort(App->Comm, EXIT_FAILURE);
+   }
+   for(int n = 0; n < nb; n++) {
+      TApp_TimerRegion     *node = &AppTimerRegions[AppTimerRegionOrder[n]];
+      TApp_TimerRegionStat *stat = APP_TIMERREGION_STAT(stats, n);
+
+      stat->Key = node->Key;
+      stat->Parent = node->Parent < 0 ? 0 : AppTimerRegions[node->Parent].Key;
+      stat->Depth = node->Depth;
+      stat->Nb = 1;
+      stat->MinRank = stat->MaxRank = App->RankMPI;
+      stat->Min = stat->Max = stat->Sum = node->Total / 1e6;
+      stat->Sum2 = stat->Sum * stat->Sum;
+      strcpy(stat->Name, node->Name);
+      if (AppTimerRegionHistoOn && node->Histo) memcpy(stat->Histo, node->Histo, sizeof(TApp_TimerHisto));
+   }
+   qsort(stats, nb, AppTimerRegionStatSize, App_TimerRegionStatCompare);
+
+   MPI_Type_contiguous(all * AppTimerRegionStatSize, MPI_BYTE, &type);
+   MPI_Type_commit(&type);
+   MPI_Op_create(App_TimerRegionStatMerge, TRUE, &op);
+   MPI_Reduce(App->RankMPI ? stats : MPI_IN_PLACE, stats, 1, type, op, 0, App->Comm);
+   MPI_Op_free(&op);
+   MPI_Type_free(&type);
+
+   free(AppTimerRegionStats);
+   AppTimerRegionStats = NULL;
+   AppTimerRegionStatNb = 0;
+   if (App->RankMPI) {
+      free(stats);
+      return 0;
+   }
+   AppTimerRegionStats = stats;
+   while (AppTimerRegionStatNb < all && APP_TIMERREGION_STAT(stats, AppTimerRegionStatNb)->Key) AppTimerRegionStatNb++;
+
+   return AppTimerRegionStatNb;
+#else
+   return 0;
+#endif
+}
+
+//! Print the cross-rank statistics of a sub tree
+static void App_TimerRegionStatPrint(
+   //! [in] Key of the parent node of the sub tree (0: roots)
+   const uint64_t Parent
+) {
+   for(int n = 0; n < AppTimerRegionStatNb; n++) {
+      TApp_TimerRegionStat *stat = APP_TIMERREGION_STAT(AppTimerRegionStats, n);
+      char                  pct[64] = "";
+
+      if (stat->Parent != Parent) continue;
+
+      double mean = stat->Sum / stat->Nb;
+      double var = stat->Sum2 / stat->Nb - mean * mean;
+
+      // Percentiles of the calls of all the ranks
+      if (AppTimerRegionHistoOn) {
+         snprintf(pct, 64, " %10.3f %10.3f %10.3f %10.3f", App_TimerHistoPercentile(stat->Histo, 50) / 1e6, App_TimerHistoPercentile(stat->Histo, 90) / 1e6,
+            App_TimerHistoPercentile(stat->Histo, 99) / 1e6, App_TimerHistoPercentile(stat->Histo, 100) / 1e6);
+      }
+      App_Log(APP_VERBATIM, "                 %*s%-*s %6d %10.3f %6d %10.3f %6d %10.3f %10.3f %8.2f%s\n", stat->Depth * 2, "", 30 - stat->Depth * 2, stat->Name,
+         stat->Nb, stat->Min, stat->MinRank, stat->Max, stat->MaxRank, mean, var > 0.0 ? sqrt(var) : 0.0, mean > 0.0 ? stat->Max / mean : 1.0, pct);
+      App_TimerRegionStatPrint(stat->Key);
+   }
+}
+
+//! Log the cross-rank statistics of the regions reduced by \ref App_TimerRegionReduce
+void App_TimerRegionStatReport(void) {
+
+   if (!AppTimerRegionStatNb) return;
+
+   App_Log(APP_VERBATIM, "Timer ranks    : %-30s %6s %10s %6s %10s %6s %10s %10s %8s%s\n", "region", "ranks", "min(ms)", "rank", "max(ms)", "rank", "mean(ms)", "std(ms)", "max/mean",
+      AppTimerRegionHistoOn ? "    p50(ms)    p90(ms)    p99(ms)  worst(ms)" : "");
+   App_TimerRegionStatPrint(0);
+}
+
+//! Reduce and log the cross-rank statistics of the regions (collective on App->Comm)
+void App_TimerRegionStats(void) {
+
+   if (App_TimerRegionReduce()) App_TimerRegionStatReport();
+}
@@ -0,0 +1,267 @@
+//! \file
+//! Timer event tracing
+//!
+//! When on (APP_TIMER_TRACE or \ref App_TimerTrace), every \ref App_TimerStop of a named timer (Name field, unnamed
+//! timers such as the internal one of the log calls are not traced) and \ref App_TimerRegionEnd appends
+//! a complete event (name, begin time and duration) to a buffer of the calling thread, up to a maximum number of
+//! events per thread and within a range of steps (App->Step). At \ref App_End, the events are written as a Chrome
+//! trace-event JSON file, viewable with chrome://tracing or https://ui.perfetto.dev, with one process per rank
+//! (labeled by the MPMD component name) and one thread per OpenMP thread. Ranks send their events to rank 0 in turn,
+//! so that no rank holds more than the events of one other rank. Times are aligned across ranks on the wall clock
+//! at the start of the trace.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "App.h"
+#include "App_Log.h"
+#include "str.h"
+
+#define APP_TIMERTRACE_NAME   48                ///< Maximum length of an event name
+
+//! Trace event
+typedef struct {
+   uint64_t Start;                              ///< Begin time (ns, CLOCK_MONOTONIC)
+   uint64_t Duration;                           ///< Duration (ns)
+   char     Name[APP_TIMERTRACE_NAME];          ///< Timer or region name
+} TApp_TimerTraceEvent;
+
+//! Trace events of a thread
+typedef struct TApp_TimerTraceBuf {
+   struct TApp_TimerTraceBuf *Next;             ///< Next thread buffer
+   int                        Thread;           ///< Thread number
+   int                        Nb;               ///< Number of events
+   int                        Lost;             ///< Number of events over the maximum
+   TApp_TimerTraceEvent      *Events;           ///< Events
+} TApp_TimerTraceBuf;
+
+volatile int AppTimerTrace = FALSE;                                     ///< Event tracing is on
+
+static char                      *AppTimerTracePath = NULL;            ///< Trace file
+static int                        AppTimerTraceMax = 100000;           ///< Maximum number of events per thread
+static int                        AppTimerTraceFirst = 0;              ///< First step traced
+static int                        AppTimerTraceLast = -1;              ///< Last step traced (-1: no limit)
+static int64_t                    AppTimerTraceOffset = 0;             ///< Wall clock minus monotonic clock at the start of the trace (ns)
+static int64_t                    AppTimerTraceOrigin = 0;             ///< Wall clock at the start of the trace (ns)
+static TApp_TimerTraceBuf        *AppTimerTraceBufs = NULL;            ///< Thread buffers
+static int                        AppTimerTraceNb = 0;                 ///< Number of thread buffers
+static pthread_mutex_t            AppTimerTraceMutex = PTHREAD_MUTEX_INITIALIZER;
+static __thread TApp_TimerTraceBuf *AppTimerTraceBuf = NULL;           ///< Buffer of the calling thread
+
+//! Configure the timer event tracing
+int App_TimerTrace(
+   //! [in] Trace file (NULL or empty to stop tracing)
+   const char * const Path,
+   //! [in] Maximum number of events per thread (<=0: keep the current maximum, 100000 by default)
+   const int Events,
+   //! [in] Steps traced, as first-last, first- or step (NULL: all steps)
+   const char * const Steps
+) {
+   //! \return APP_OK, APP_ERR if the step range is invalid
+   //! \note Has to be called by all the ranks, the trace being written collectively by \ref App_End
+   struct timespec real, mono;
+   int             first = 0, last = -1, n = 0;
+
+   if (Steps && *Steps) {
+      if (sscanf(Steps, "%d%n", &first, &n) != 1 || first < 0) return APP_ERR;
+      if (Steps[n] == '-') {
+         if (Steps[n + 1] && (sscanf(&Steps[n + 1], "%d", &last) != 1 || last < first)) return APP_ERR;
+      } else if (!Steps[n]) {
+         last = first;
+      } else {
+         return APP_ERR;
+      }
+   }
+
+   pthread_mutex_lock(&AppTimerTraceMutex);
+   AppTimerTraceFirst = first;
+   AppTimerTraceLast = last;
+   if (Events > 0 && !AppTimerTraceBufs) AppTimerTraceMax = Events;
+
+   free(AppTimerTracePath);
+   AppTimerTracePath = Path && *Path ? strdup(Path) : NULL;
+
+   if (AppTimerTracePath && !AppTimerTrace) {
+      clock_gettime(CLOCK_REALTIME, &real);
+      clock_gettime(APP_CLOCK_ID, &mono);
+      AppTimerTraceOffset = ((int64_t)real.tv_sec - mono.tv_sec) * 1000000000 + real.tv_nsec - mono.tv_nsec;
+      AppTimerTraceOrigin = (int64_t)real.tv_sec * 1000000000 + real.tv_nsec;
+   }
+   AppTimerTrace = AppTimerTracePath != NULL;
+   pthread_mutex_unlock(&AppTimerTraceMutex);
+
+   return APP_OK;
+}
+
+//! Append an event to the buffer of the calling thread
+void App_TimerTraceAdd(
+   //! [in] Event name
+   const char * const Name,
+   //! [in] Length of the name
+   const int Len,
+   //! [in] Begin time (ns, CLOCK_MONOTONIC)
+   const uint64_t Start,
+   //! [in] Duration (ns)
+   const uint64_t Duration
+) {
+   TApp_TimerTraceBuf   *buf = AppTimerTraceBuf;
+   TApp_TimerTraceEvent *evt;
+   int                   len = MIN(Len, APP_TIMERTRACE_NAME - 1);
+
+   if (App->Step < AppTimerTraceFirst || (AppTimerTraceLast >= 0 && App->Step > AppTimerTraceLast)) return;
+
+   // First event of the thread
+   if (!buf) {
+      if (!(buf = (TApp_TimerTraceBuf*)calloc(1, sizeof(TApp_TimerTraceBuf)))) return;
+      if (!(buf->Events = (TApp_TimerTraceEvent*)malloc(AppTimerTraceMax * sizeof(TApp_TimerTraceEvent)))) {
+         free(buf);
+         return;
+      }
+      pthread_mutex_lock(&AppTimerTraceMutex);
+#ifdef HAVE_OPENMP
+      buf->Thread = omp_get_thread_num();
+#else
+      buf->Thread = AppTimerTraceNb;
+#endif
+      buf->Next = AppTimerTraceBufs;
+      AppTimerTraceBufs = buf;
+      AppTimerTraceNb++;
+      pthread_mutex_unlock(&AppTimerTraceMutex);
+      AppTimerTraceBuf = buf;
+   }
+
+   if (buf->Nb >= AppTimerTraceMax) {
+      buf->Lost++;
+      return;
+   }
+   evt = &buf->Events[buf->Nb];
+   evt->Start = Start;
+   evt->Duration = Duration;
+   memcpy(evt->Name, Name, len);
+   evt->Name[len] = '\0';
+   buf->Nb++;
+}
+
+//! Append the latest start/stop cycle of a timer to the trace
+void App_TimerTraceTimer(
+   //! [in] Timer just stopped
+   const TApp_Timer * const Timer
+) {
+   //! \note Called by \ref App_TimerStop when tracing, for named timers only
+   App_TimerTraceAdd(Timer->Name, strlen(Timer->Name), Timer->StartNs, Timer->LatestTimeNs);
+}
+
+//! Format the events of this rank
+static char* App_TimerTraceFormat(
+   //! [in] Wall clock time of the origin of the trace (ns)
+   const int64_t Origin,
+   //! [in] First entry of the trace (no separator)
+   const int First,
+   //! [out] Length of the formatted events
+   size_t *Size
+) {
+   //! \return Formatted events, to be freed
+   const char *component = App->Name ? App->Name : "";
+   char       *str = NULL, name[6 * APP_TIMERTRACE_NAME + 1];
+   FILE       *out;
+   int         lost = 0, len;
+
+   if (!(out = open_memstream(&str, Size))) return NULL;
+
+#ifdef HAVE_MPI
+   if (App->SelfComponent) component = App->SelfComponent->name;
+#endif
+   len = App_LogJSONEscape(name, component, MIN(strlen(component), APP_TIMERTRACE_NAME));
+   fprintf(out, "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"%.*s %d\"}}", First ? "" : ",\n", App->RankMPI, len, name, App->RankMPI);
+   fprintf(out, ",\n{\"name\":\"process_sort_index\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"sort_index\":%d}}", App->RankMPI, App->RankMPI);
+
+   for(TApp_TimerTraceBuf *buf = AppTimerTraceBufs; buf; buf = buf->Next) {
+      fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}", App->RankMPI, buf->Thread, buf->Thread);
+
+      for(int e = 0; e < buf->Nb; e++) {
+         TApp_TimerTraceEvent *evt = &buf->Events[e];
+
+         len = App_LogJSONEscape(name, evt->Name, strlen(evt->Name));
+         fprintf(out, ",\n{\"name\":\"%.*s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", len, name, App->RankMPI, buf->Thread,
+            ((int64_t)evt->Start + AppTimerTraceOffset - Origin) / 1e3, evt->Duration / 1e3);
+      }
+      lost += buf->Lost;
+      buf->Nb = buf->Lost = 0;
+   }
+   fclose(out);
+
+   if (lost) {
+      App_Log(APP_WARNING, "%s: %d trace events over the maximum of %d per thread were dropped\n", __func__, lost, AppTimerTraceMax);
+   }
+   return str;
+}
+
+//! Write the trace file and stop tracing
+void App_TimerTraceWrite(
+   //! [in] Called collectively on App->Comm, rank 0 writing the events of all the ranks
+   const int Collective
+) {
+   //! \note Called by \ref App_End, without collective call, ranks other than 0 write to their own file (Path.rank)
+   char    *str, *path = AppTimerTracePath;
+   size_t   size = 0;
+   int64_t  origin = AppTimerTraceOrigin;
+   FILE    *fd = NULL;
+   int      root = !Collective || !App->RankMPI;
+
+   if (!AppTimerTrace || !path) return;
+   AppTimerTrace = FALSE;
+
+   if (!Collective && App->RankMPI) {
+      path = (char*)malloc(strlen(AppTimerTracePath) + 16);
+      sprintf(path, "%s.%d", AppTimerTracePath, App->RankMPI);
+   }
+
+#ifdef HAVE_MPI
+   // Origin at the start of the earliest rank
+   if (Collective) {
+      MPI_Allreduce(MPI_IN_PLACE, &origin, 1, MPI_INT64_T, MPI_MIN, App->Comm);
+   }
+#endif
+   if (!(str = App_TimerTraceFormat(origin, root, &size))) size = 0;
+
+   if (root) {
+      if (!(fd = fopen(path, "w"))) {
+         App_Log(APP_ERROR, "%s: Unable to open trace file %s\n", __func__, path);
+      } else {
+         fprintf(fd, "{\"traceEvents\":[\n");
+         fwrite(str, 1, size, fd);
+      }
+   }
+
+#ifdef HAVE_MPI
+   if (Collective) {
+      int  len = size, *lens = NULL;
+      char *buf = NULL;
+
+      if (!App->RankMPI) lens = (int*)calloc(App->NbMPI, sizeof(int));
+      MPI_Gather(&len, 1, MPI_INT, lens, 1, MPI_INT, 0, App->Comm);
+
+      if (App->RankMPI) {
+         if (len) MPI_Send(str, len, MPI_CHAR, 0, 0, App->Comm);
+      } else {
+         for(int r = 1; r < App->NbMPI; r++) {
+            if (!lens[r]) continue;
+            buf = (char*)realloc(buf, lens[r]);
+            MPI_Recv(buf, lens[r], MPI_CHAR, r, 0, App->Comm, MPI_STATUS_IGNORE);
+            if (fd) fwrite(buf, 1, lens[r], fd);
+         }
+         free(buf);
+         free(lens);
+      }
+   }
+#endif
+
+   if (fd) {
+      fprintf(fd, "\n],\"displayTimeUnit\":\"ms\"}\n");
+      fclose(fd);
+   }
+   if (path != AppTimerTracePath) free(path);
+   free(str);
+}
@@ -160,4 +160,20 @@ static inline int32_t atomic_add_int32(
     return new_value;
 }
 
+//! Atomically reserve space in a ring buffer, if there is enough room left
+//! \return Start position of the reserved space, -1 if the ring is full
+static inline int64_t try_reserve_int64(
+    volatile int64_t *head,       //!< Reservation position, advanced by the reserved length
+    volatile int64_t *tail,       //!< Position up to which the ring has been consumed
+    int64_t size,                 //!< Size of the ring
+    int64_t length                //!< How much space we want to reserve
+) {
+    int64_t old_value;
+    do {
+        old_value = *head;
+        if (old_value + length - *tail > size) return -1;
+    } while (__sync_val_compare_and_swap(head, old_value, old_value + length) != old_value);
+    return old_value;
+}
+
 #endif
@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include "App_MPMD.h"
 #include "App_build_info.h"
 
@@ -9,12 +11,46 @@ int32_t finalize() {
     return(TRUE);
 }
 
+//! Decode a binary log file (app decode -i [file] ...)
+int decode(int argc, char *argv[]) {
+
+    int32_t rank=-1,n;
+    char   *in=NULL,*out=NULL,*level=NULL,*lib=NULL;
+    FILE   *fd=stdout;
+
+    TApp_Arg appargs[]=
+      { { APP_CHAR,  &in,      1,             "i", "input",  "Binary log file" },
+        { APP_CHAR,  &out,     1,             "o", "output", "Decoded log file (default: stdout)" },
+        { APP_INT32, &rank,    1,             "r", "rank",   "Only messages from this rank" },
+        { APP_CHAR,  &level,   1,             "e", "level",  "Only messages up to this level (ERROR, WARNING, INFO, STAT, TRIVIAL, DEBUG, EXTRA)" },
+        { APP_CHAR,  &lib,     1,             "b", "lib",    "Only messages from this library (main, rmn, fst, ...)" },
+        { APP_NIL } };
+
+    App_Init(APP_MASTER,"app decode",VERSION,"Binary log decoder",GIT_COMMIT_TIMESTAMP);
+    if (!App_ParseArgs(appargs,argc,argv,APP_NOARGSFAIL) || !in) {
+       exit(EXIT_FAILURE);
+    }
+
+    if (out && !(fd=fopen(out,"w"))) {
+       App_Log(APP_ERROR,"Unable to open output file %s\n",out);
+       exit(EXIT_FAILURE);
+    }
+    n=App_LogDecode(in,fd,rank,level,lib);
+
+    if (fd!=stdout) fclose(fd);
+    return(n<0?EXIT_FAILURE:EXIT_SUCCESS);
+}
+
 int main(int argc, char *argv[]) {
 
     int32_t step=0,fail=-1,ok;
     int64_t queued=0;
     char   *title=NULL;
 
+    if (argc>1 && !strcmp(argv[1],"decode")) {
+       return(decode(argc-1,&argv[1]));
+    }
+
 #ifdef HAVE_MPI
     MPI_Init(NULL, NULL);
 #endif
@@ -0,0 +1,60 @@
+#include <string.h>
+#include <mpi.h>
+
+#include <App.h>
+
+#define NB_MSG  2000
+#define MSG_LEN 1500
+
+int main(void) {
+
+    char msg[MSG_LEN + 1];
+
+    MPI_Init(NULL, NULL);
+    App_Init(APP_MASTER, "log_append", "test", "shared log file single write test", "now");
+    App_LogStream("log_append.log");
+    App_LogLevel("INFO");
+    App_LogRank(-1);
+    App_Start();
+
+    // The first rank creates (truncates) the file
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    // Lines longer than the stdio buffer once a few are queued, made of the rank digit
+    memset(msg, '0' + App->RankMPI % 10, MSG_LEN);
+    msg[MSG_LEN] = '\0';
+    for(int i = 0; i < NB_MSG; i++) {
+        App_Log(APP_INFO, "%s\n", msg);
+    }
+    int nb = App->NbMPI;
+    App_End(0);
+
+    // No line may be torn by the records of another rank
+    int status = 0;
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (!App->RankMPI) {
+        FILE *fd = fopen("log_append.log", "r");
+        char  line[2 * MSG_LEN];
+        int   n = 0, rank;
+
+        while (fd && fgets(line, 2 * MSG_LEN, fd)) {
+            if (sscanf(line, "P%d (INFO) ", &rank) == 1) {
+                char *m = strstr(line, ") ") + 2;
+                if (strspn(m, (char[]){ '0' + rank % 10, 0 }) != MSG_LEN || m[MSG_LEN] != '\n') {
+                    fprintf(stderr, "Torn line from rank %d\n", rank);
+                    status = 1;
+                    break;
+                }
+                n++;
+            }
+        }
+        if (fd) fclose(fd);
+
+        if (n != nb * NB_MSG) {
+            fprintf(stderr, "Found %d messages out of %d\n", n, nb * NB_MSG);
+            status = 1;
+        }
+    }
+    MPI_Finalize();
+    return status;
+}
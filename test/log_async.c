@@ -0,0 +1,39 @@
+#include <omp.h>
+#include <string.h>
+
+#include <App.h>
+
+#define NB_THREAD 8
+#define NB_MSG    20000
+
+int main(void) {
+
+    App_Init(APP_MASTER, "log_async", "test", "asynchronous log writer test", "now");
+    App_LogStream("log_async.log");
+    App_LogAsync(64 * 1024, APP_LOGASYNC_BLOCK);
+    App_LogLevel("INFO");
+    App_Start();
+
+    #pragma omp parallel num_threads(NB_THREAD)
+    {
+        for(int i = 0; i < NB_MSG; i++) {
+            App_Log(APP_INFO, "Message %d from thread %d\n", i, omp_get_thread_num());
+        }
+    }
+    App_End(0);
+
+    // Every message must have made it to the file
+    FILE *fd = fopen("log_async.log", "r");
+    char  line[256];
+    int   n = 0;
+    while (fd && fgets(line, 256, fd)) {
+        if (strstr(line, "(INFO) Message ")) n++;
+    }
+    if (fd) fclose(fd);
+
+    if (n != NB_THREAD * NB_MSG) {
+        fprintf(stderr, "Found %d messages out of %d\n", n, NB_THREAD * NB_MSG);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include <math.h>
+
+#include <App.h>
+
+#define NB_CALL 50000000
+#define NB_LOG  1000000
+
+//! Stand-in for an expensive argument
+static double cost(int i) {
+    return sqrt((double)i) * log((double)i + 1.0);
+}
+
+int main(void) {
+
+    TApp_Timer inline_timer, call_timer, log_timer;
+
+    App_Init(APP_MASTER, "log_bench", "test", "log call cost", "now");
+    App_LogStream("/dev/null");
+    App_LogLevel("WARNING");
+    App_LogTime("DATETIME");
+    App->LogThread = TRUE;
+
+    App_TimerInit(&inline_timer);
+    App_TimerInit(&call_timer);
+    App_TimerInit(&log_timer);
+
+    // Disabled messages through the inline level check (arguments are not evaluated)
+    App_TimerStart(&inline_timer);
+    for(int i = 0; i < NB_CALL; i++) {
+        App_Log(APP_DEBUG, "Iteration %d value %f\n", i, cost(i));
+        __asm__ volatile("" : : : "memory");
+    }
+    App_TimerStop(&inline_timer);
+
+    // Disabled messages through the out-of-line varargs call
+    App_TimerStart(&call_timer);
+    for(int i = 0; i < NB_CALL; i++) {
+        (Lib_Log)(APP_MAIN, APP_DEBUG, "Iteration %d value %f\n", i, cost(i));
+        __asm__ volatile("" : : : "memory");
+    }
+    App_TimerStop(&call_timer);
+
+    // Enabled messages with time and thread prefix
+    App_TimerStart(&log_timer);
+    for(int i = 0; i < NB_LOG; i++) {
+        Lib_Log(APP_LIBFST, APP_WARNING, "Iteration %d\n", i);
+    }
+    App_TimerStop(&log_timer);
+
+    printf("Disabled message cost: inline check %.3f ns/call, function call %.3f ns/call\n",
+        App_TimerTotalTime_ms(&inline_timer) * 1e6 / NB_CALL, App_TimerTotalTime_ms(&call_timer) * 1e6 / NB_CALL);
+    printf("Enabled message cost: %.3f ns/call\n", App_TimerTotalTime_ms(&log_timer) * 1e6 / NB_LOG);
+
+    return 0;
+}
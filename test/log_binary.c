@@ -0,0 +1,49 @@
+#include <string.h>
+
+#include <App.h>
+
+int main(void) {
+
+    char  line[1024], dyn[64];
+    int   n = 0;
+    FILE *fd;
+
+    remove("log_binary.bin");
+    App_Init(APP_MASTER, "log_binary", "test", "binary log format test", "now");
+    App_LogStream("log_binary.bin");
+    App_LogFormat("BINARY");
+    App_LogLevel("DEBUG");
+    App_Start();
+    TApp_Lib mylib = App_LibRegisterDynamic("mylib", NULL);
+
+    for(int i = 0; i < 3; i++) {
+        App_Log(APP_INFO, "int=%d long=%ld size=%zu dbl=%.3f str=%s char=%c width=%*d%%\n", i, 1234567890123L, (size_t)7, 3.14159, "hello", 'x', 5, 42);
+        snprintf(dyn, 64, "dynamic format %d %%s\n", i);
+        Lib_Log(APP_LIBFST, APP_DEBUG, dyn, "ok");
+        Lib_Log(mylib, APP_INFO, "run time library %d\n", i);
+    }
+    // Unknown level names are an error, not a level
+    if (App_LogDecode("log_binary.bin", stdout, -1, "VERBOSE", NULL) != -1) return 1;
+    App_End(0);
+
+    // Decode and check the reconstructed messages
+    if (!(fd = fopen("log_binary.txt", "w"))) return 1;
+    if (App_LogDecode("log_binary.bin", fd, -1, "DEBUG", NULL) < 9) return 1;
+    // Run time libraries are decoded by name
+    if (App_LogDecode("log_binary.bin", fd, -1, NULL, "MyLib") != 3) return 1;
+    fclose(fd);
+
+    if (!(fd = fopen("log_binary.txt", "r"))) return 1;
+    while (fgets(line, 1024, fd)) {
+        if (strstr(line, "(INFO) int=2 long=1234567890123 size=7 dbl=3.142 str=hello char=x width=   42%")) n++;
+        if (strstr(line, "(DEBUG) FST|dynamic format 1 ok")) n++;
+        if (strstr(line, "(INFO) MYLIB|run time library 1")) n++;
+    }
+    fclose(fd);
+
+    if (n != 4) {
+        fprintf(stderr, "Decoded messages do not match\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include <string.h>
+#include <mpi.h>
+
+#include <App.h>
+
+#define NB_STEP 4
+
+int main(void) {
+
+    MPI_Init(NULL, NULL);
+    App_Init(APP_MASTER, "log_collect", "test", "deferred collective messages test", "now");
+    App_LogStream("log_collect.log");
+    App_LogCollect(TRUE);
+    App_LogRank(-1);
+    App_Start();
+
+    int rank = App->RankMPI;
+    for(int s = 1; s <= NB_STEP; s++) {
+        App_LogStep(s);
+        // Agreed on at the next step, logged at the one after
+        if (s == 1) App_Log((rank == 2 ? APP_ERROR : APP_QUIET) + APP_COLLECT, "Step %d error on rank %d\n", s, rank);
+        if (s == 2) App_Log((rank == 1 ? APP_WARNING : APP_QUIET) + APP_COLLECT, "Step %d warning on rank %d\n", s, rank);
+    }
+    // Agreed on right away
+    App_Log((rank == 3 ? APP_WARNING : APP_QUIET) + APP_COLLECT, "Checkpoint warning on rank %d\n", rank);
+    App_LogCollectSync(TRUE);
+    App_Log(APP_INFO, "After checkpoint\n");
+
+    // Agreed on at the end
+    App_Log((rank == 1 ? APP_ERROR : APP_INFO) + APP_COLLECT, "Last message on rank %d\n", rank);
+    App_End(0);
+
+    int status = 0;
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (!rank) {
+        const char *expect[] = {
+            "P002 (ERROR) #3 Step 1 error on rank 2\n",
+            "P001 (WARNING) #4 Step 2 warning on rank 1\n",
+            "P003 (WARNING) #4 Checkpoint warning on rank 3\n",
+            "P000 (ERROR) #4 Last message on rank 0\n",
+            "P001 (ERROR) #4 Last message on rank 1\n",
+            "Status         : Ok (5 Errors) (2 Warnings)\n"
+        };
+        int   found[6] = { 0 }, n = 0;
+        char  line[256];
+        FILE *fd = fopen("log_collect.log", "r");
+
+        while (fd && fgets(line, 256, fd)) {
+            for(int e = 0; e < 6; e++) {
+                if (strstr(line, expect[e])) found[e]++;
+            }
+            if (strstr(line, "on rank")) n++;
+        }
+        if (fd) fclose(fd);
+
+        for(int e = 0; e < 6; e++) {
+            if (found[e] != 1) {
+                fprintf(stderr, "Found %d times: %s", found[e], expect[e]);
+                status = 1;
+            }
+        }
+        // Every rank logs its last message at the agreed level
+        if (n != 7) {
+            fprintf(stderr, "Found %d messages out of 7\n", n);
+            status = 1;
+        }
+    }
+    MPI_Finalize();
+    return status;
+}
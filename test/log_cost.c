@@ -0,0 +1,45 @@
+#include <string.h>
+
+#include <App.h>
+
+#define NB_MSG 1000
+
+int main(void) {
+
+    char  line[1024];
+    int   head = 0, lib = 0, sites = 0, top = 0;
+    FILE *fd;
+
+    App_Init(APP_MASTER, "log_cost", "test", "log cost accounting test", "now");
+    App_LogStream("log_cost.log");
+    App_LogLevel("DEBUG");
+    App_LogCost(2, FALSE);
+    App_Start();
+
+    for(int i = 0; i < NB_MSG; i++) {
+        Lib_Log(APP_LIBFST, APP_DEBUG, "Expensive library message %d %s\n", i, "with a long argument to make it the most expensive one by far, which it should be");
+        if (i % 10 == 0) App_Log(APP_INFO, "Main message %d\n", i);
+        if (i % 100 == 0) App_Log(APP_INFO, "Rare message %d\n", i);
+    }
+    App_End(0);
+
+    if (!(fd = fopen("log_cost.log", "r"))) return 1;
+    while (fgets(line, 1024, fd)) {
+        if (strncmp(line, "Log cost       : library", 24) == 0) head++;
+        if (strstr(line, " fst ") && strstr(line, " 1000 ")) lib++;
+        if (strncmp(line, "                 main ", 22) == 0) lib++;
+        if (strstr(line, "log_cost.c:")) {
+            sites++;
+            // Most expensive first
+            if (strncmp(line, "Top log sites  : ", 17) == 0 && strstr(line, "\"Expensive library message %d %s\" (fst) 1000 messages")) top++;
+        }
+    }
+    fclose(fd);
+
+    if (head != 1 || lib != 2 || sites != 2 || top != 1) {
+        fprintf(stderr, "Found %d headers, %d libraries out of 2, %d sites out of 2, %d top site\n", head, lib, sites, top);
+        return 1;
+    }
+    printf("Log cost test passed\n");
+    return 0;
+}
@@ -0,0 +1,59 @@
+#include <string.h>
+
+#include <App.h>
+
+int main(void) {
+
+    char  line[1024];
+    int   status = 0, fst = 0, skip = 0, main = 0, warn = 0, after = 0, site = 0, iter = 0, step = 0;
+    FILE *fd;
+
+    App_Init(APP_MASTER, "log_filter", "test", "log filter test", "now");
+    App_LogStream("log_filter.log");
+    App_LogLevel("DEBUG");
+    if (App_LogFilter("+lib:^fst$;-msg:^Skip") != APP_OK) status = 1;
+    if (App_LogFilter("+lib:(") != APP_ERR || App_LogFilter("+name:fst") != APP_ERR) status = 1;
+    App_Start();
+
+    for(int i = 0; i < 100; i++) {
+        Lib_Log(APP_LIBFST, APP_DEBUG, "Kept library message %d\n", i);
+        Lib_Log(APP_LIBFST, APP_DEBUG, "Skipped library message %d\n", i);
+        App_Log(APP_INFO, "Filtered main message %d\n", i);
+    }
+    App_Log(APP_WARNING, "Warnings are never filtered\n");
+
+    // The cached results of the call sites are dropped with the filter
+    App_LogFilter("-site:log_filter\\.c");
+    App_Log(APP_INFO, "Filtered by call site\n");
+
+    // Formats without literal text and calls without a call site are matched on the message
+    App_LogFilter("-msg:^Iteration");
+    for(int i = 0; i < 4; i++) {
+        App_Log(APP_INFO, "%s %d\n", i % 2 ? "Iteration" : "Step", i);
+        (Lib_Log)(APP_MAIN, APP_INFO, "%s %d\n", i % 2 ? "Iteration" : "Step", i);
+    }
+    App_LogFilter(NULL);
+    for(int i = 0; i < 2; i++) {
+        App_Log(APP_INFO, "Main message without filter %d\n", i);
+    }
+    App_End(0);
+
+    if (!(fd = fopen("log_filter.log", "r"))) return 1;
+    while (fgets(line, 1024, fd)) {
+        if (strstr(line, "FST|Kept library message")) fst++;
+        if (strstr(line, "Skipped library message")) skip++;
+        if (strstr(line, "Filtered main message")) main++;
+        if (strstr(line, "Warnings are never filtered")) warn++;
+        if (strstr(line, "Filtered by call site")) site++;
+        if (strstr(line, "Main message without filter")) after++;
+        if (strstr(line, "Iteration ")) iter++;
+        if (strstr(line, "Step ")) step++;
+    }
+    fclose(fd);
+
+    if (status || fst != 100 || skip || main || site || warn != 1 || after != 2 || iter || step != 4) {
+        fprintf(stderr, "Found %d kept, %d skipped, %d main, %d site, %d warnings, %d after, %d iterations, %d steps\n", fst, skip, main, site, warn, after, iter, step);
+        status = 1;
+    }
+    return status;
+}
@@ -0,0 +1,43 @@
+#include <string.h>
+
+#include <App.h>
+
+int main(void) {
+
+    char  line[1024];
+    int   n = 0, bad = 0;
+    FILE *fd;
+
+    App_Init(APP_MASTER, "log_json", "test", "JSON log format test", "now");
+    App_LogStream("log_json.log");
+    App_LogFormat("JSON");
+    App_LogLevel("DEBUG");
+    App_Start();
+
+    for(int i = 0; i < 3; i++) {
+        App_Log(APP_INFO, "Message %d with \"quotes\", a \\ and a\ttab\nover two lines\n", i);
+        App_LogStep(i + 1);
+        Lib_Log(APP_LIBFST, APP_DEBUG, "Library message %d\n", i);
+    }
+    App_End(0);
+
+    // Every line must be a single object
+    if (!(fd = fopen("log_json.log", "r"))) return 1;
+    while (fgets(line, 1024, fd)) {
+        size_t len = strlen(line);
+        if (strncmp(line, "{\"time\":\"", 9) || len < 4 || strcmp(line + len - 3, "\"}\n")) {
+            fprintf(stderr, "Invalid record: %s", line);
+            bad++;
+        }
+        if (strstr(line, "\"level\":\"INFO\",\"msg\":\"Message 1 with \\\"quotes\\\", a \\\\ and a\\ttab\\nover two lines\"}")
+            && strstr(line, "\"thread\":0,\"step\":1,\"lib\":\"main\"")) n++;
+        if (strstr(line, "\"step\":2,\"lib\":\"fst\",\"level\":\"DEBUG\",\"msg\":\"Library message 1\"}")) n++;
+    }
+    fclose(fd);
+
+    if (bad || n != 2) {
+        fprintf(stderr, "Found %d invalid records and %d expected messages out of 2\n", bad, n);
+        return 1;
+    }
+    return 0;
+}
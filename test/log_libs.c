@@ -0,0 +1,55 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <App.h>
+
+int main(void) {
+
+    char  line[1024];
+    int   status = 0, version = 0, mine = 0, other = 0;
+    FILE *fd;
+
+    // Level of a library App does not know about, read before it is registered
+    setenv("APP_VERBOSE_MYLIB", "DEBUG", 1);
+    // Misspelled library, must not take a library slot
+    setenv("APP_VERBOSE_MYLIBB", "DEBUG", 1);
+
+    App_Init(APP_MASTER, "log_libs", "test", "dynamic library registration test", "now");
+    App_LogStream("log_libs.log");
+
+    TApp_Lib mylib = App_LibRegisterDynamic("mylib", "1.2.3");
+    TApp_Lib otherlib = App_LibRegisterDynamic("OtherLib", NULL);
+    if (mylib != APP_LIBMETA + 1 || otherlib != APP_LIBMETA + 2) {
+        fprintf(stderr, "Invalid library ids %d %d\n", mylib, otherlib);
+        status = 1;
+    }
+    if (App_LibRegisterDynamic("MYLIB", NULL) != mylib || App_LibRegisterDynamic("rmn", NULL) != APP_LIBRMN) {
+        fprintf(stderr, "Known libraries registered again\n");
+        status = 1;
+    }
+    if (App_LibRegisterDynamic("a_library_name_longer_than_the_maximum", NULL) != -1) {
+        fprintf(stderr, "Library name over the maximum length registered\n");
+        status = 1;
+    }
+    App_Start();
+
+    Lib_Log(mylib, APP_DEBUG, "Debug message of mylib\n");
+    Lib_Log(otherlib, APP_DEBUG, "Debug message of otherlib\n");
+    Lib_Log(otherlib, APP_WARNING, "Warning message of otherlib\n");
+    App_End(0);
+
+    if (!(fd = fopen("log_libs.log", "r"))) return 1;
+    while (fgets(line, 1024, fd)) {
+        if (strstr(line, "mylib       : 1.2.3")) version++;
+        if (strstr(line, "(DEBUG) MYLIB|Debug message of mylib")) mine++;
+        if (strstr(line, "(WARNING) OTHERLIB|Warning message of otherlib")) other++;
+        if (strstr(line, "Debug message of otherlib")) other += 10;
+    }
+    fclose(fd);
+
+    if (version != 1 || mine != 1 || other != 1) {
+        fprintf(stderr, "Found version %d, mylib %d, otherlib %d\n", version, mine, other);
+        status = 1;
+    }
+    return status;
+}
@@ -0,0 +1,46 @@
+#include <omp.h>
+#include <string.h>
+
+#include <App.h>
+
+#define NB_THREAD 8
+#define NB_MSG    20000
+
+int main(void) {
+
+    App_Init(APP_MASTER, "log_mmap", "test", "memory mapped log writer test", "now");
+    App_LogStream("log_mmap.log");
+    App_LogMmap(64 * 1024);
+    App_LogLevel("INFO");
+    App_Start();
+
+    #pragma omp parallel num_threads(NB_THREAD)
+    {
+        for(int i = 0; i < NB_MSG; i++) {
+            App_Log(APP_INFO, "Message %d from thread %d\n", i, omp_get_thread_num());
+        }
+    }
+    App_End(0);
+
+    // Every message must have made it to the file, and the file must be truncated after the footer
+    FILE *fd = fopen("log_mmap.log", "r");
+    char  line[256];
+    int   n = 0, footer = 0, zero = 0, c;
+    while (fd && fgets(line, 256, fd)) {
+        if (strstr(line, "(INFO) Message ")) n++;
+        if (strstr(line, "Status         : Ok")) footer = 1;
+    }
+    if (fd) {
+        rewind(fd);
+        while ((c = fgetc(fd)) != EOF) {
+            if (!c) zero++;
+        }
+        fclose(fd);
+    }
+
+    if (n != NB_THREAD * NB_MSG || !footer || zero) {
+        fprintf(stderr, "Found %d messages out of %d, footer %d, %d null bytes\n", n, NB_THREAD * NB_MSG, footer, zero);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,58 @@
+#include <string.h>
+#include <mpi.h>
+
+#include <App.h>
+
+#define NB_STEP 10
+#define NB_MSG  500
+
+int main(void) {
+
+    MPI_Init(NULL, NULL);
+    App_Init(APP_MASTER, "log_mpiio", "test", "MPI-IO shared log file test", "now");
+    App_LogStream("log_mpiio.log");
+    App_LogMPIIO(4096);
+    App_LogLevel("INFO");
+    App_LogRank(-1);
+    App_Start();
+
+    for(int s = 1; s <= NB_STEP; s++) {
+        App_LogStep(s);
+        for(int i = 0; i < NB_MSG; i++) {
+            App_Log(APP_INFO, "Message %d\n", i);
+        }
+    }
+    int nb = App->NbMPI;
+    App_End(0);
+
+    // Every message must be in the file, in order for each rank, and each step must come after the previous one
+    int status = 0;
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (!App->RankMPI) {
+        FILE *fd = fopen("log_mpiio.log", "r");
+        char  line[256];
+        int   n = 0, rank, step, msg, last[256], laststep = 0;
+
+        memset(last, -1, sizeof(last));
+        while (fd && fgets(line, 256, fd)) {
+            if (sscanf(line, "P%d (INFO) #%d Message %d", &rank, &step, &msg) == 3) {
+                if (rank < 0 || rank >= 256 || step < laststep || (msg != last[rank] + 1 && !(msg == 0 && last[rank] == NB_MSG - 1))) {
+                    fprintf(stderr, "Out of order message: %s", line);
+                    status = 1;
+                    break;
+                }
+                last[rank] = msg;
+                laststep = step;
+                n++;
+            }
+        }
+        if (fd) fclose(fd);
+
+        if (n != nb * NB_STEP * NB_MSG) {
+            fprintf(stderr, "Found %d messages out of %d\n", n, nb * NB_STEP * NB_MSG);
+            status = 1;
+        }
+    }
+    MPI_Finalize();
+    return status;
+}
@@ -0,0 +1,79 @@
+#include <string.h>
+#include <mpi.h>
+
+#include <App.h>
+
+int main(void) {
+
+    MPI_Init(NULL, NULL);
+    App_Init(APP_MASTER, "log_ranks", "test", "rank selection test", "now");
+    App_LogStream("log_ranks.log");
+    App_LogLevel("INFO");
+    App_LogRanks("0,NODE");
+    App_Start();
+
+    // The first rank creates (truncates) the file
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    int status = 0;
+    int rank = App->RankMPI;
+
+    // Selections are evaluated once per process
+    const char *ranks[] = { "1,3", "/2", "1-", "0-3/3", "NODE", "COMPONENT", "2-2" };
+    const int   expect[] = { 0x0A, 0x05, 0x0E, 0x09, 0x01, 0x01, 0x04 };
+    for(int s = 0; s < 7; s++) {
+        if (App_LogRanks(ranks[s]) != APP_OK) {
+            fprintf(stderr, "Rejected selection %s\n", ranks[s]);
+            status = 1;
+        }
+        if (App_IsLogging() != ((expect[s] >> rank) & 1)) {
+            fprintf(stderr, "Rank %d wrongly selected by %s\n", rank, ranks[s]);
+            status = 1;
+        }
+        App_Log(APP_INFO, "Selection %d\n", s);
+    }
+
+    // A single rank is kept as such
+    if (App_LogRanks("2") != APP_OK || App->LogRank != 2 || App_IsLogging() != (rank == 2)) {
+        fprintf(stderr, "Single rank selection not kept\n");
+        status = 1;
+    }
+
+    const char *invalid[] = { "1-0", "x", "0/0", "-3" };
+    for(int s = 0; s < 4; s++) {
+        if (App_LogRanks(invalid[s]) != APP_ERR) {
+            fprintf(stderr, "Accepted selection %s\n", invalid[s]);
+            status = 1;
+        }
+    }
+    App_LogRanks("ALL");
+    App_End(0);
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (!rank) {
+        char  line[256];
+        int   n = 0, s, r, found[7] = { 0 };
+        FILE *fd = fopen("log_ranks.log", "r");
+
+        while (fd && fgets(line, 256, fd)) {
+            if (sscanf(line, "P%d (INFO) Selection %d", &r, &s) == 2 && s >= 0 && s < 7) {
+                if (!((expect[s] >> r) & 1)) {
+                    fprintf(stderr, "Unexpected message from rank %d for %s\n", r, ranks[s]);
+                    status = 1;
+                }
+                found[s]++;
+                n++;
+            }
+        }
+        if (fd) fclose(fd);
+
+        for(s = 0; s < 7; s++) {
+            if (found[s] != __builtin_popcount(expect[s])) {
+                fprintf(stderr, "Found %d messages for %s\n", found[s], ranks[s]);
+                status = 1;
+            }
+        }
+    }
+    MPI_Finalize();
+    return status;
+}
@@ -0,0 +1,52 @@
+#include <omp.h>
+#include <string.h>
+
+#include <App.h>
+
+#define NB_THREAD 8
+#define NB_MSG    1000
+
+int main(void) {
+
+    App_Init(APP_MASTER, "log_rate", "test", "call site rate limiting test", "now");
+    App_LogStream("log_rate.log");
+    App_LogLevel("INFO");
+    App_Start();
+
+    #pragma omp parallel num_threads(NB_THREAD)
+    {
+        for(int i = 0; i < NB_MSG; i++) {
+            App_Log(APP_INFO | APP_ONCE, "Once message\n");
+            App_Log(APP_WARNING | APP_EVERY_N(100), "Every 100 message\n");
+            App_Log(APP_INFO | APP_EVERY_SECONDS(3600), "Every hour message\n");
+            App_Log(APP_DEBUG | APP_ONCE, "Disabled message\n");
+        }
+    }
+    // Same format, different call site
+    App_Log(APP_INFO | APP_ONCE, "Once message\n");
+    App_End(0);
+
+    FILE *fd = fopen("log_rate.log", "r");
+    char  line[256];
+    int   once = 0, every = 0, hour = 0, disabled = 0, summary = 0;
+    while (fd && fgets(line, 256, fd)) {
+        if (strstr(line, "Suppressed ")) {
+            if (strstr(line, "Suppressed 7999 repeats of \"Once message\"")) summary++;
+            if (strstr(line, "Suppressed 7920 repeats of \"Every 100 message\"")) summary++;
+            if (strstr(line, "Suppressed 7999 repeats of \"Every hour message\"")) summary++;
+            if (strstr(line, "Disabled message")) summary = -100;
+        } else {
+            if (strstr(line, "(INFO) Once message")) once++;
+            if (strstr(line, "(WARNING) Every 100 message")) every++;
+            if (strstr(line, "(INFO) Every hour message")) hour++;
+            if (strstr(line, "Disabled message")) disabled++;
+        }
+    }
+    if (fd) fclose(fd);
+
+    if (once != 2 || every != NB_THREAD * NB_MSG / 100 || hour != 1 || disabled || summary != 3) {
+        fprintf(stderr, "Found once=%d every=%d hour=%d disabled=%d summary=%d\n", once, every, hour, disabled, summary);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <App.h>
+
+#define NB_MSG  100
+#define NB_KEPT 16
+
+//! Log debug messages above the log level, then die by an error or a signal
+static void run(const char *File, int Signal) {
+
+    App_Init(APP_MASTER, "log_recorder", "test", "flight recorder test", "now");
+    App_LogStream(File);
+    App_LogLevel("WARNING");
+    App_ToleranceLevel("ERROR");
+    App_LogRecorder("DEBUG", NB_KEPT * 256);
+    App_Start();
+
+    for(int i = 0; i < NB_MSG; i++) {
+        App_Log(APP_DEBUG, "Debug %d\n", i);
+        App_Log(APP_EXTRA, "Extra %d\n", i);
+    }
+    if (Signal) {
+        raise(Signal);
+    } else {
+        App_Log(APP_ERROR, "Giving up\n");
+    }
+    exit(0);
+}
+
+//! Check the dump of the recorder in a log file
+static int check(const char *File) {
+
+    char  line[1024], msg[64];
+    int   found[NB_MSG] = { 0 }, head = 0, extra = 0, err = 0;
+    FILE *fd;
+
+    if (!(fd = fopen(File, "r"))) {
+        fprintf(stderr, "%s: missing\n", File);
+        return 1;
+    }
+    while (fgets(line, 1024, fd)) {
+        if (strstr(line, "Flight recorder")) head++;
+        if (strstr(line, "Extra ")) extra++;
+        for(int i = 0; i < NB_MSG; i++) {
+            snprintf(msg, 64, "Debug %d\n", i);
+            if (strstr(line, msg)) found[i]++;
+        }
+    }
+    fclose(fd);
+
+    // Only the last records of the ring are dumped, once
+    for(int i = 0; i < NB_MSG; i++) {
+        if (found[i] != (i >= NB_MSG - NB_KEPT)) {
+            fprintf(stderr, "%s: message %d found %d times\n", File, i, found[i]);
+            err = 1;
+        }
+    }
+    if (head != 1 || extra) {
+        fprintf(stderr, "%s: %d recorder headers, %d extra messages\n", File, head, extra);
+        err = 1;
+    }
+    return err;
+}
+
+int main(void) {
+
+    int   status, err = 0;
+    pid_t pid;
+
+    // Abort on an error above the tolerance level
+    if (!(pid = fork())) run("log_recorder.log", 0);
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) == 0) {
+        fprintf(stderr, "Error did not abort (status %d)\n", status);
+        err = 1;
+    }
+    err |= check("log_recorder.log");
+
+    // Crash, the signal has to go through
+    if (!(pid = fork())) run("log_recorder_crash.log", SIGSEGV);
+    waitpid(pid, &status, 0);
+    if (!WIFSIGNALED(status) || WTERMSIG(status) != SIGSEGV) {
+        fprintf(stderr, "Crash did not end with SIGSEGV (status %d)\n", status);
+        err = 1;
+    }
+    err |= check("log_recorder_crash.log");
+
+    if (!err) printf("Flight recorder test passed\n");
+    return err;
+}
@@ -0,0 +1,76 @@
+#include <string.h>
+#include <sys/stat.h>
+
+#include <App.h>
+
+#define NB_MSG   5000
+#define SEG_SIZE 16384
+
+//! Check that a segment exists, is not over a size and contains a string
+static int check(const char *File, int Compress, long Max, const char *Str) {
+
+    char  cmd[1024], line[1024];
+    int   found = 0;
+    long  len = 0;
+    FILE *fd;
+
+    snprintf(cmd, 1024, Compress ? "gzip -dc %s.gz 2>/dev/null" : "cat %s 2>/dev/null", File);
+    if (!(fd = popen(cmd, "r"))) return -1;
+    while (fgets(line, 1024, fd)) {
+        len += strlen(line);
+        if (Str && strstr(line, Str)) found = 1;
+    }
+    pclose(fd);
+
+    if (!len || len > Max || (Str && !found)) {
+        fprintf(stderr, "Segment %s: %li bytes, \"%s\" %s\n", File, len, Str ? Str : "", found ? "found" : "not found");
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+
+    char        name[256];
+    struct stat st;
+    int         compress = argc > 1 && strcmp(argv[1], "gz") == 0;
+    int         nb = 0, last = 0;
+
+    App_Init(APP_MASTER, "log_rotate", "test", "log file rotation test", "now");
+    App_LogStream("log_rotate.log");
+    if (App_LogRotate(SEG_SIZE, 3, compress) != APP_OK) {
+        fprintf(stderr, "Compression not available, skipping\n");
+        return 0;
+    }
+    App_LogLevel("INFO");
+    App_Start();
+
+    for(int i = 0; i < NB_MSG; i++) {
+        App_Log(APP_INFO, "Message %d\n", i);
+    }
+    App_End(0);
+
+    // Only the first and the last 2 segments are kept
+    for(int s = 1; s < 1000; s++) {
+        snprintf(name, 256, "log_rotate.log.%03d%s", s, compress ? ".gz" : "");
+        if (stat(name, &st) == 0) {
+            nb++;
+            last = s;
+        }
+    }
+    if (nb != 2 || last < 3) {
+        fprintf(stderr, "Found %d rotated segments, last is %d\n", nb, last);
+        return 1;
+    }
+
+    // Header box in the first segment, footer box in the last one
+    if (check("log_rotate.log", compress, SEG_SIZE, "Application    : log_rotate")) return 1;
+    snprintf(name, 256, "log_rotate.log.%03d", last - 1);
+    if (check(name, compress, SEG_SIZE, NULL)) return 1;
+    // The footer box is never cut, the last segment can exceed the size by it
+    snprintf(name, 256, "log_rotate.log.%03d", last);
+    if (check(name, compress, SEG_SIZE + 4096, "Application    : log_rotate")) return 1;
+    if (check(name, compress, SEG_SIZE + 4096, "Status         : Ok")) return 1;
+
+    return 0;
+}
@@ -0,0 +1,53 @@
+#include <string.h>
+#include <mpi.h>
+
+#include <App.h>
+
+#define NB_MSG 5000
+
+int main(void) {
+
+    MPI_Init(NULL, NULL);
+    App_Init(APP_MASTER, "log_shared", "test", "shared memory log ring test", "now");
+    App_LogStream("log_shared.log");
+    App_LogShared(16 * 1024);
+    App_LogLevel("INFO");
+    App_LogRank(-1);
+    App_Start();
+
+    for(int i = 0; i < NB_MSG; i++) {
+        App_Log(APP_INFO, "Message %d\n", i);
+    }
+    int nb = App->NbMPI;
+    App_End(0);
+
+    // Every message must be in the file, in order for each rank
+    int status = 0;
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (!App->RankMPI) {
+        FILE *fd = fopen("log_shared.log", "r");
+        char  line[256];
+        int   n = 0, rank, msg, last[256];
+
+        memset(last, -1, sizeof(last));
+        while (fd && fgets(line, 256, fd)) {
+            if (sscanf(line, "P%d (INFO) Message %d", &rank, &msg) == 2) {
+                if (rank < 0 || rank >= 256 || msg != last[rank] + 1) {
+                    fprintf(stderr, "Out of order message from rank %d: %s", rank, line);
+                    status = 1;
+                    break;
+                }
+                last[rank] = msg;
+                n++;
+            }
+        }
+        if (fd) fclose(fd);
+
+        if (n != nb * NB_MSG) {
+            fprintf(stderr, "Found %d messages out of %d\n", n, nb * NB_MSG);
+            status = 1;
+        }
+    }
+    MPI_Finalize();
+    return status;
+}
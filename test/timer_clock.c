@@ -0,0 +1,60 @@
+#include <string.h>
+
+#include <App.h>
+
+//! Check the timers against a sleep and the nanosecond resolution
+static int check(const char *Clock) {
+
+    TApp_Timer timer = NULL_TIMER;
+    int        fine = FALSE;
+
+    App_TimerStart(&timer);
+    sleep_us(2000);
+    App_TimerStop(&timer);
+    if (App_TimerLatestTime_ms(&timer) < 2.0 || App_TimerLatestTime_ms(&timer) > 50.0) {
+        fprintf(stderr, "%s: %.3f ms measured for a 2 ms sleep\n", Clock, App_TimerLatestTime_ms(&timer));
+        return 1;
+    }
+    for(int i = 0; i < 100 && !fine; i++) {
+        App_TimerStart(&timer);
+        App_TimerStop(&timer);
+        fine = timer.LatestTimeNs % 1000 != 0;
+    }
+    if (!fine) {
+        fprintf(stderr, "%s: No sub-microsecond interval measured\n", Clock);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void) {
+
+    int status = 0;
+
+    App_Init(APP_MASTER, "timer_clock", "test", "timer clock test", "now");
+    App_Start();
+
+    status |= check("MONOTONIC");
+
+    if (App_TimerClock("TSC") == APP_OK) {
+        struct timespec now;
+        uint64_t        tsc = get_current_time_ns();
+
+        // Both clocks give the same times
+        clock_gettime(APP_CLOCK_ID, &now);
+        int64_t diff = (int64_t)((uint64_t)now.tv_sec * 1000000000 + now.tv_nsec) - (int64_t)tsc;
+        if (diff < -1000000 || diff > 1000000) {
+            fprintf(stderr, "TSC clock off by %ld ns\n", (long)diff);
+            status = 1;
+        }
+        status |= check("TSC");
+    } else {
+        printf("No invariant TSC, clock_gettime kept\n");
+    }
+    if (App_TimerClock("MONOTONIC") != APP_OK || App_TimerClock("SUNDIAL") != APP_ERR || AppTimerTSC.On) {
+        status = 1;
+    }
+    App_End(0);
+
+    return status;
+}
@@ -0,0 +1,79 @@
+#include <string.h>
+#include <mpi.h>
+
+#include <App.h>
+
+int main(void) {
+
+    MPI_Init(NULL, NULL);
+    App_Init(APP_MASTER, "timer_histo", "test", "timer histogram test", "now");
+    App_LogStream("timer_histo.log");
+    App_TimerRegionHisto(TRUE);
+    App_Start();
+
+    int status = 0;
+    int rank = App->RankMPI;
+
+    // Buckets are exact below 16 ns, within 1/32 above
+    TApp_TimerHisto histo = { 0 };
+    App_TimerHistoAdd(&histo, 7);
+    if (App_TimerHistoPercentile(&histo, 50) != 7.0) status = 1;
+    for(uint64_t t = 1000; t < 1000000000000ULL; t *= 7) {
+        memset(&histo, 0, sizeof(histo));
+        App_TimerHistoAdd(&histo, t);
+        App_TimerHistoAdd(&histo, t * 2);
+        double p = App_TimerHistoPercentile(&histo, 50);
+        if (p < t * (1 - 1.0 / 32) || p > t * (1 + 1.0 / 32)) {
+            fprintf(stderr, "Percentile %.0f for %lu\n", p, (unsigned long)t);
+            status = 1;
+        }
+    }
+
+    // Rank 3 has a few slow calls
+    TApp_Timer *timer = App_TimerCreate();
+    App_TimerHisto(timer);
+    for(int i = 0; i < 100; i++) {
+        App_TimerRegionBegin("step");
+        App_TimerStart(timer);
+        sleep_us(rank == 3 && i % 10 == 0 ? 20000 : 100);
+        App_TimerStop(timer);
+        App_TimerRegionEnd("step");
+    }
+    if (App_TimerPercentile_ms(timer, 50) < 0.1 || App_TimerPercentile_ms(timer, 50) > 5.0) {
+        fprintf(stderr, "Rank %d median of %.3f ms\n", rank, App_TimerPercentile_ms(timer, 50));
+        status = 1;
+    }
+    App_TimerHistoReduce(timer);
+    if (!rank && (timer->Histo->Nb != 400 || App_TimerPercentile_ms(timer, 99) < 20.0 || App_TimerPercentile_ms(timer, 100) < 20.0)) {
+        fprintf(stderr, "Merged timer histogram of %lu intervals, p99 %.3f ms\n", (unsigned long)timer->Histo->Nb, App_TimerPercentile_ms(timer, 99));
+        status = 1;
+    }
+    App_TimerDelete(timer);
+    App_End(0);
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (!rank) {
+        char  line[1024], name[64];
+        int   ranks, rmin, rmax, local = 0, all = 0;
+        unsigned long calls;
+        double incl, excl, min, max, mean, std, imb, p50, p90, p99, worst;
+        FILE *fd = fopen("timer_histo.log", "r");
+
+        while (fd && fgets(line, 1024, fd)) {
+            if (strncmp(line + 17, "step", 4)) continue;
+            // Rank 0 only, then all the ranks
+            if (sscanf(line + 17, "%63s %lu %lf %lf %lf %lf %lf %lf", name, &calls, &incl, &excl, &p50, &p90, &p99, &worst) == 8
+                && calls == 100 && p99 < 5.0 && p50 >= 0.1) local++;
+            if (sscanf(line + 17, "%63s %d %lf %d %lf %d %lf %lf %lf %lf %lf %lf %lf", name, &ranks, &min, &rmin, &max, &rmax, &mean, &std, &imb, &p50, &p90, &p99, &worst) == 13
+                && ranks == 4 && p50 < 5.0 && p99 >= 20.0 && worst >= 20.0) all++;
+        }
+        if (fd) fclose(fd);
+
+        if (local != 1 || all != 1) {
+            fprintf(stderr, "Found %d local and %d cross-rank percentiles\n", local, all);
+            status = 1;
+        }
+    }
+    MPI_Finalize();
+    return status;
+}
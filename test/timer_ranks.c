@@ -0,0 +1,64 @@
+#include <string.h>
+#include <mpi.h>
+
+#include <App.h>
+
+int main(void) {
+
+    MPI_Init(NULL, NULL);
+    App_Init(APP_MASTER, "timer_ranks", "test", "cross-rank timer statistics test", "now");
+    App_LogStream("timer_ranks.log");
+    App_Start();
+
+    int status = 0;
+    int rank = App->RankMPI;
+
+    // Ranks create their regions in different orders and with different sets
+    if (rank == 2) {
+        App_TimerRegionBegin("init");
+        App_TimerRegionEnd("init");
+    }
+    for(int i = 0; i < 2; i++) {
+        App_TimerRegionBegin("step");
+        App_TimerRegionBegin("dyn");
+        sleep_us((rank + 1) * 2000);
+        App_TimerRegionEnd("dyn");
+        if (rank == 3) {
+            App_TimerRegionBegin("io");
+            App_TimerRegionEnd("io");
+        }
+        App_TimerRegionEnd("step");
+    }
+    if (rank != 2) {
+        App_TimerRegionBegin("init");
+        App_TimerRegionEnd("init");
+    }
+    App_End(0);
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (!rank) {
+        char  line[1024], name[64];
+        int   ranks, rmin, rmax, stats = 0, found = 0;
+        double min, max, mean, std, imb;
+        FILE *fd = fopen("timer_ranks.log", "r");
+
+        while (fd && fgets(line, 1024, fd)) {
+            if (strncmp(line, "Timer ranks    : region", 23) == 0) stats = 1;
+            if (!stats || strncmp(line, "                 ", 17)) continue;
+            if (sscanf(line + 17, "%63s %d %lf %d %lf %d %lf %lf %lf", name, &ranks, &min, &rmin, &max, &rmax, &mean, &std, &imb) != 9) continue;
+
+            if (!strcmp(name, "step") && ranks == 4 && rmin == 0 && rmax == 3 && min >= 4.0 && max >= 16.0 && imb > 1.2 && std > 0.0) found++;
+            if (!strcmp(name, "dyn") && ranks == 4 && rmin == 0 && rmax == 3) found++;
+            if (!strcmp(name, "io") && ranks == 1 && rmin == 3 && rmax == 3) found++;
+            if (!strcmp(name, "init") && ranks == 4) found++;
+        }
+        if (fd) fclose(fd);
+
+        if (found != 4) {
+            fprintf(stderr, "Found %d regions out of 4\n", found);
+            status = 1;
+        }
+    }
+    MPI_Finalize();
+    return status;
+}
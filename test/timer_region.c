@@ -0,0 +1,60 @@
+#include <string.h>
+
+#include <App.h>
+
+int main(void) {
+
+    char  line[1024], name[64];
+    int   status = 0, head = 0, found = 0, depth;
+    unsigned long calls;
+    double incl, excl;
+    FILE *fd;
+
+    App_Init(APP_MASTER, "timer_region", "test", "timer region test", "now");
+    App_LogStream("timer_region.log");
+    App_Start();
+
+    for(int i = 0; i < 5; i++) {
+        App_TimerRegionBegin("step");
+        App_TimerRegionBegin("dyn");
+        App_TimerRegionBegin("advection");
+        sleep_us(2000);
+        App_TimerRegionEnd("advection");
+        sleep_us(1000);
+        App_TimerRegionEnd("dyn");
+        // Same name in another parent is another node
+        App_TimerRegionBegin("phy");
+        App_TimerRegionBegin("advection");
+        App_TimerRegionEnd("advection");
+        App_TimerRegionEnd("phy");
+        App_TimerRegionEnd("step");
+    }
+    if (App_TimerRegionEnd(NULL) != APP_ERR) status = 1;
+    // Names are truncated, ending with the full name must still match
+    App_TimerRegionBegin("a_region_name_much_longer_than_the_maximum_length_kept_for_a_timer_region");
+    if (App_TimerRegionEnd("a_region_name_much_longer_than_the_maximum_length_kept_for_a_timer_region") != APP_OK) status = 1;
+    App_TimerRegionBegin("a");
+    if (App_TimerRegionEnd("b") != APP_ERR) status = 1;
+    App_End(0);
+
+    if (!(fd = fopen("timer_region.log", "r"))) return 1;
+    while (fgets(line, 1024, fd)) {
+        if (strncmp(line, "Timer regions  : region", 23) == 0) head++;
+        if (strncmp(line, "                 ", 17) || sscanf(line + 17, "%63s %lu %lf %lf", name, &calls, &incl, &excl) != 4) continue;
+        depth = (strspn(line + 17, " ")) / 2;
+
+        if (!strcmp(name, "step") && depth == 0 && calls == 5 && incl >= 15.0) found++;
+        if (!strcmp(name, "dyn") && depth == 1 && calls == 5 && excl >= 5.0 && excl < incl) found++;
+        if (!strcmp(name, "advection") && depth == 2 && calls == 5 && incl >= 10.0 && incl == excl) found++;
+        if (!strcmp(name, "phy") && depth == 1 && calls == 5) found++;
+        if (!strcmp(name, "advection") && depth == 2 && calls == 5 && incl < 1.0) found++;
+        if (!strcmp(name, "a") && depth == 0 && calls == 1) found++;
+    }
+    fclose(fd);
+
+    if (status || head != 1 || found != 6) {
+        fprintf(stderr, "Found %d headers, %d regions out of 6 (status %d)\n", head, found, status);
+        status = 1;
+    }
+    return status;
+}
@@ -0,0 +1,70 @@
+#include <string.h>
+#include <mpi.h>
+
+#include <App.h>
+
+int main(void) {
+
+    MPI_Init(NULL, NULL);
+    App_Init(APP_MASTER, "timer_trace", "test", "timer trace test", "now");
+    App_LogStream("timer_trace.log");
+    if (App_TimerTrace("timer_trace.json", 100, "1-") != APP_OK || App_TimerTrace("timer_trace.json", 100, "2-1") != APP_ERR) {
+        fprintf(stderr, "Wrong step range check\n");
+    }
+    // Only steps 1 and 2, at most 100 events per thread
+    App_TimerTrace("timer_trace.json", 100, "1-2");
+    App_Start();
+
+    int status = 0;
+    int rank = App->RankMPI;
+    TApp_Timer *kernel = App_TimerCreate();
+    TApp_Timer *unnamed = App_TimerCreate();
+    kernel->Name = "kernel";
+
+    for(App->Step = 0; App->Step < 4; App->Step++) {
+        App_TimerRegionBegin(App->Step == 1 || App->Step == 2 ? "step" : "outside");
+        App_TimerStart(kernel);
+        sleep_us(1000);
+        App_TimerStop(kernel);
+        // Unnamed timers, the log timer included, are not traced
+        App_TimerStart(unnamed);
+        App_TimerStop(unnamed);
+        App_Log(APP_WARNING, "Step %d\n", App->Step);
+        App_TimerRegionEnd(NULL);
+    }
+    // Over the maximum
+    App->Step = 2;
+    for(int i = 0; i < 200; i++) {
+        App_TimerRegionBegin("tiny");
+        App_TimerRegionEnd("tiny");
+    }
+    App_End(0);
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (!rank) {
+        char  line[1024];
+        int   head = 0, procs = 0, events = 0, steps = 0, kernels = 0, outside = 0, unnamed = 0, tail = 0;
+        FILE *fd = fopen("timer_trace.json", "r");
+
+        while (fd && fgets(line, 1024, fd)) {
+            if (!strcmp(line, "{\"traceEvents\":[\n")) head++;
+            if (strstr(line, "\"process_name\"") && strstr(line, "timer_trace")) procs++;
+            if (strstr(line, "\"ph\":\"X\"")) events++;
+            if (strstr(line, "{\"name\":\"step\",\"ph\":\"X\"")) steps++;
+            if (strstr(line, "{\"name\":\"kernel\",\"ph\":\"X\"")) kernels++;
+            if (strstr(line, "\"outside\"")) outside++;
+            if (strstr(line, "\"ph\":\"X\"") && !strstr(line, "{\"name\":\"step\"") && !strstr(line, "{\"name\":\"kernel\"") && !strstr(line, "{\"name\":\"tiny\"")) unnamed++;
+            if (!strcmp(line, "],\"displayTimeUnit\":\"ms\"}\n")) tail++;
+        }
+        if (fd) fclose(fd);
+
+        if (head != 1 || tail != 1 || procs != 4 || events != 400 || steps != 8 || kernels != 8 || outside || unnamed) {
+            fprintf(stderr, "Found %d headers, %d tails, %d processes, %d events, %d steps, %d kernels, %d outside, %d unnamed\n", head, tail, procs, events, steps, kernels, outside, unnamed);
+            status = 1;
+        }
+    }
+    App_TimerDelete(kernel);
+    App_TimerDelete(unnamed);
+    MPI_Finalize();
+    return status;
+}